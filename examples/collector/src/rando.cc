@@ -27,6 +27,7 @@ limitations under the License.
 using Plugin::Config;
 using Plugin::ConfigPolicy;
 using Plugin::Metric;
+using Plugin::MetricBatch;
 using Plugin::Meta;
 using Plugin::Type;
 using Plugin::Flags;
@@ -126,20 +127,18 @@ std::vector<Metric> Rando::collect_metrics(std::vector<Metric> &metrics) {
                 mets_iter.set_data(std::to_string(random_value));
                 break;
             }
-            mets_iter.set_timestamp();
             result_metrics.push_back(mets_iter);
         } else {
-            for (int i = 0 ; i < mets_iter.get_config().get_int("dynamic_count") ; i++){
-                Metric dynamic_metric;
-                Namespace dynamic_namespace(mets_iter.ns());
-                dynamic_namespace[4].set_value(std::to_string(i));
-                dynamic_metric.set_ns(dynamic_namespace);
-                dynamic_metric.set_data((uint64_t)random_value);
-                dynamic_metric.set_timestamp();
-                result_metrics.push_back(dynamic_metric);
+            int dynamic_count = mets_iter.get_config().get_int("dynamic_count");
+            MetricBatch batch(mets_iter, 4);
+            batch.reserve(dynamic_count);
+            for (int i = 0 ; i < dynamic_count ; i++){
+                batch.add(std::to_string(i), (uint64_t)random_value);
             }
+            batch.move_to(result_metrics);
         }
     }
+    Metric::set_timestamps(result_metrics);
     return result_metrics;
 }
 
@@ -45,12 +45,13 @@ void Graffiti::process_metrics(std::vector<Metric> &metrics,
     std::vector<Metric>::iterator mets_iter;
     std::string tags_str = config.get_string("tags");
 
-    std::vector<std::string> tags = split_tags(tags_str);
+    std::vector<std::pair<std::string, std::string>> tags;
+    for (std::string tag : split_tags(tags_str)) {
+        tags.emplace_back(tag, "present");
+    }
 
     for (mets_iter = metrics.begin(); mets_iter != metrics.end(); mets_iter++) {
-        for (std::string tag : tags) {
-        mets_iter->add_tag(std::pair<std::string, std::string>(tag, "present"));
-        }
+        mets_iter->add_tags(tags);
     }
 }
 
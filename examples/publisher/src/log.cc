@@ -46,6 +46,24 @@ const ConfigPolicy Log::get_config_policy() {
     return policy;
 }
 
+namespace {
+    /**
+     * DataPrinter writes a metric's datapoint, as given by Metric::visit.
+     */
+    struct DataPrinter {
+        std::ofstream& outfile;
+
+        template<typename T>
+        void operator()(const T& value) const {
+            outfile << value << "\n";
+        }
+
+        void operator()(const Metric::NoData&) const {
+            outfile << "not set\n";
+        }
+    };
+}  // namespace
+
 /**
  * {ISO 8601 timestamp} {namespace} tags: [{tags}] data: {data}
  */
@@ -68,14 +86,15 @@ void Log::publish_metrics(std::vector<Metric> &metrics,
         }
 
         // namespace
-        for ( NamespaceElement nse : mets_iter->ns().get_namespace_elements()) {
-            outfile << "/" << nse.get_value();
+        Plugin::NamespaceView ns = mets_iter->ns();
+        for (int i = 0; i < ns.size(); i++) {
+            outfile << "/" << ns[i].get_value();
         }
 
         // tags
         outfile << " tags: [";
-        std::map<std::string, std::string>::iterator tags_iter;
-        std::map<std::string, std::string> tags = mets_iter->tags();
+        Metric::Tags::const_iterator tags_iter;
+        const Metric::Tags& tags = mets_iter->tags();
         int tags_size = tags.size();
         int idx = 1;
         for (tags_iter = tags.begin(); tags_iter != tags.end();
@@ -87,35 +106,7 @@ void Log::publish_metrics(std::vector<Metric> &metrics,
 
         // data
         outfile << "] " << "data: ";
-        switch (mets_iter->data_type()) {
-        case Metric::DataType::Float32:
-            outfile << mets_iter->get_float32_data() << "\n";
-            break;
-        case Metric::DataType::Float64:
-            outfile << mets_iter->get_float64_data() << "\n";
-            break;
-        case Metric::DataType::Int32:
-            outfile << mets_iter->get_int_data() << "\n";
-            break;
-        case Metric::DataType::Int64:
-            outfile << mets_iter->get_int64_data() << "\n";
-            break;
-        case Metric::DataType::Uint32:
-            outfile << mets_iter->get_uint32_data() << "\n";
-            break;
-        case Metric::DataType::Uint64:
-            outfile << mets_iter->get_uint64_data() << "\n";
-            break;
-        case Metric::DataType::Bool:
-            outfile << mets_iter->get_bool_data() << "\n";
-            break;
-        case Metric::DataType::String:
-            outfile << mets_iter->get_string_data() << "\n";
-            break;
-        case Metric::DataType::NotSet:
-            outfile << "not set\n";
-            break;
-        }
+        mets_iter->visit(DataPrinter{outfile});
     }
 }
 
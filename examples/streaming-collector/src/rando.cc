@@ -136,8 +136,8 @@ void Rando::stream_metrics() {
             default:
                 send_error_message("Invalid type: " + ns_mts_type);
             }
-            mets_iter->set_timestamp();
         }
+        Metric::set_timestamps(_metrics);
         send_metrics(_metrics);
         lock.unlock();
         std::this_thread::sleep_for(std::chrono::milliseconds(1000));
@@ -0,0 +1,47 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/clock.h"
+
+#include <time.h>
+
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+
+using Plugin::Clock;
+using Plugin::ClockSource;
+
+std::atomic<ClockSource> Clock::_source(ClockSource::Precise);
+
+system_clock::time_point Clock::now() {
+#ifdef CLOCK_REALTIME_COARSE
+    if (_source.load(std::memory_order_relaxed) == ClockSource::Coarse) {
+        struct timespec ts;
+        if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0) {
+            return system_clock::time_point(duration_cast<system_clock::duration>(
+                        seconds(ts.tv_sec) + nanoseconds(ts.tv_nsec)));
+        }
+    }
+#endif
+    return system_clock::now();
+}
+
+void Clock::set_source(ClockSource source) {
+    _source.store(source, std::memory_order_relaxed);
+}
+
+ClockSource Clock::get_source() {
+    return _source.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,52 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace Plugin {
+    /**
+    * ClockSource selects how Clock reads the wall-clock time.
+    */
+    enum class ClockSource {
+        /**
+        * std::chrono::system_clock, precise to the nanosecond.
+        */
+        Precise,
+        /**
+        * CLOCK_REALTIME_COARSE where available: only as precise as the
+        * scheduler tick (a few milliseconds) but much cheaper to read.
+        * Falls back to Precise on other platforms.
+        */
+        Coarse,
+    };
+
+    /**
+    * Clock is the wall clock used for the metrics timestamps set by the
+    * library (@see Metric::set_timestamp). Its source is chosen per plugin
+    * through Meta::clock_source.
+    */
+    class Clock final {
+    public:
+        static std::chrono::system_clock::time_point now();
+
+        static void set_source(ClockSource source);
+        static ClockSource get_source();
+
+    private:
+        static std::atomic<ClockSource> _source;
+    };
+
+}   // namespace Plugin
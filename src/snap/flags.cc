@@ -19,6 +19,7 @@ limitations under the License.
 #include <json.hpp>
 
 #include "snap/flags.h"
+#include "snap/plugin.h"
 
 // Set default option values
 // Default global flags:
@@ -30,7 +31,7 @@ limitations under the License.
 #define ROOT_CERT_PATHS ""
 #define CIPHER_SUITES ""
 #define STAND_ALONE_PORT 8182
-#define MAX_COLLECT_DURATION 10
+#define MAX_COLLECT_DURATION "10s"
 #define MAX_METRICS_BUFFER 0
 
 // Default hidden flags:
@@ -99,10 +100,25 @@ int Plugin::Flags::addDefaultGlobalFlags() {
             ("stand-alone", "Enable stand-alone plugin")
             ("stand-alone-port", po::value<int>(&_stand_alone_port)->default_value(STAND_ALONE_PORT),
                 "Specify http port when stand-alone is set")
-            ("max-collect-duration", po::value<int>(&_max_collect_duration)->default_value(MAX_COLLECT_DURATION),
-                "In seconds, sets the maximum duration (always greater than 0s) between collections before metrics are sent")
+            ("max-collect-duration", po::value<std::string>(&_max_collect_duration)->default_value(MAX_COLLECT_DURATION),
+                "Maximum duration between collections before metrics are sent (e.g. 10s, 10ms, in seconds without a unit)")
             ("max-metrics-buffer", po::value<int64_t>(&_max_metrics_buffer)->default_value(MAX_METRICS_BUFFER),
-                "Maximum number of metrics the plugin is buffering before sending metrics");
+                "Maximum number of metrics the plugin is buffering before sending metrics")
+            ("max-in-flight", po::value<int64_t>(), "Maximum number of metrics batches waiting to be sent before sending blocks (0 for unlimited)")
+            ("coalesce-metrics", "Only buffer the latest metric per namespace until metrics are sent")
+            ("overflow-policy", po::value<std::string>(), "What to do with metrics past max-in-flight: block, drop-oldest, drop-newest, sample or coalesce-latest")
+            ("overflow-sample-rate", po::value<int>(), "With the sample overflow policy, one out of how many batches are kept")
+            ("async-server", "Enable the asynchronous GRPC server")
+            ("max-recv-msg-size", po::value<int>(), "In bytes, maximum size of a received message (-1 for unlimited)")
+            ("max-send-msg-size", po::value<int>(), "In bytes, maximum size of a sent message (-1 for unlimited)")
+            ("resource-quota", po::value<int64_t>(), "In bytes, memory quota of the GRPC server")
+            ("resource-quota-threads", po::value<int>(), "Maximum number of threads of the GRPC server")
+            ("sync-server-threads", po::value<int>(), "Maximum number of threads polling for calls in the sync GRPC server")
+            ("completion-queues", po::value<int>(), "Number of completion queues of the GRPC server")
+            ("keepalive-time", po::value<int>(), "In milliseconds, interval between keepalive pings (0 to disable)")
+            ("keepalive-timeout", po::value<int>(), "In milliseconds, how long to wait for a keepalive ping acknowledgement")
+            ("compression", po::value<std::string>(), "Compression of sent metrics: none, deflate or gzip")
+            ("compression-threshold", po::value<int64_t>(), "Size in bytes from which sent metrics are compressed");
         _config_file.add(_global);
         return 0;
     }
@@ -520,6 +536,32 @@ int64_t Plugin::Flags::GetFlagInt64Value(const char *flagKey) {
     }
 }
 
+std::chrono::nanoseconds Plugin::Flags::GetFlagDurationValue(const char *flagKey) {
+    static const std::map<std::string, std::chrono::nanoseconds> units{
+        {"ns", std::chrono::nanoseconds(1)},
+        {"us", std::chrono::microseconds(1)},
+        {"ms", std::chrono::milliseconds(1)},
+        {"s", std::chrono::seconds(1)},
+        {"m", std::chrono::minutes(1)},
+        {"h", std::chrono::hours(1)},
+        {"", std::chrono::seconds(1)}
+    };
+    std::string value = GetFlagStrValue(flagKey);
+    try {
+        size_t unit_start = value.find_first_not_of("0123456789");
+        auto unit = units.find(unit_start == std::string::npos ? "" : value.substr(unit_start));
+        if (unit_start != 0 && !value.empty() && unit != units.end()) {
+            return std::stoll(value.substr(0, unit_start)) * unit->second;
+        }
+    }
+    catch (std::exception &e) {
+        _logger->error(e.what());
+    }
+    // A duration of 0 has a meaning of its own (e.g. sending metrics right
+    // away), so a typo must not silently turn into one.
+    throw Plugin::PluginException(std::string("Invalid duration for ") + flagKey + ": " + value);
+}
+
 std::string Plugin::Flags::GetFlagStrValue(const char *flagKey) {
     try {
         if (_flags.count(flagKey)) {
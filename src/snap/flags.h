@@ -14,6 +14,7 @@ limitations under the License.
 #pragma once
 
 #include <boost/program_options.hpp>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <iterator>
@@ -54,7 +55,8 @@ namespace Plugin {
         po::options_description _visible, _command_line, _config_file;
 
         // Default variables
-        int _log_level, _stand_alone_port, _max_collect_duration;
+        int _log_level, _stand_alone_port;
+        std::string _max_collect_duration;
         std::string _options_file, _listen_port, _listen_addr, _cert_path, _key_path, _root_cert_paths;
         int64_t _max_metrics_buffer;
 
@@ -127,6 +129,14 @@ namespace Plugin {
         int64_t GetFlagInt64Value(const char *flagKey);
         std::string GetFlagStrValue(const char *flagKey);
 
+        /**
+        * GetFlagDurationValue reads a string flag holding a duration: an
+        * integer followed by a unit among ns, us, ms, s, m and h. Without a
+        * unit, the integer is a number of seconds.
+        * An invalid duration throws a PluginException.
+        */
+        std::chrono::nanoseconds GetFlagDurationValue(const char *flagKey);
+
         void SetFlagsLogLevel(const int &logLevel = 2);
 
         int helpFlagCalled() {
@@ -15,6 +15,7 @@ limitations under the License.
 #include "snap/grpc_export.h"
 #include "snap/grpc_export_impl.h"
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <future>
@@ -22,6 +23,7 @@ limitations under the License.
 #include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <sys/stat.h>
 
 #include <grpc++/grpc++.h>
@@ -32,6 +34,7 @@ limitations under the License.
 
 #include "snap/rpc/plugin.pb.h"
 
+#include "snap/proxy/async_server.h"
 #include "snap/proxy/collector_proxy.h"
 #include "snap/proxy/processor_proxy.h"
 #include "snap/proxy/publisher_proxy.h"
@@ -181,6 +184,7 @@ future<void> Plugin::GRPCExportImpl::DoExport(shared_ptr<PluginInterface> plugin
     this->credentials = configureCredentials();
     doConfigure();
     doRegister();
+    doStartReactor();
 
     if (this->meta->stand_alone) {
         return std::async(std::launch::deferred, &Plugin::GRPCExportImpl::start_stand_alone, this,
@@ -218,30 +222,103 @@ void Plugin::GRPCExportImpl::doConfigure() {
     ss << this->meta->listen_addr << ":";
     this->meta->listen_port == "" ? ss << "0" : ss << this->meta->listen_port;
 
+    Proxy::Compression compression(this->meta->compression_algorithm,
+                                   this->meta->compression_threshold);
+    this->reactor.reset(new Reactor());
     switch (plugin->GetType()) {
-        case Plugin::Collector:
-            this->service.reset(new Proxy::CollectorImpl(plugin->IsCollector()));
+        case Plugin::Collector: {
+            auto collector = new Proxy::CollectorImpl(plugin->IsCollector());
+            collector->SetCompression(compression);
+            this->service.reset(collector);
             break;
-        case Plugin::Processor:
-            this->service.reset(new Proxy::ProcessorImpl(plugin->IsProcessor()));
+        }
+        case Plugin::Processor: {
+            auto processor = new Proxy::ProcessorImpl(plugin->IsProcessor());
+            processor->SetCompression(compression);
+            this->service.reset(processor);
             break;
+        }
         case Plugin::Publisher:
             this->service.reset(new Proxy::PublisherImpl(plugin->IsPublisher()));
             break;
-        case Plugin::StreamCollector:
-            this->service.reset(new Proxy::StreamCollectorImpl(plugin->IsStreamCollector()));
+        case Plugin::StreamCollector: {
+            auto stream_collector = new Proxy::StreamCollectorImpl(plugin->IsStreamCollector());
+            stream_collector->SetCompression(compression);
+            stream_collector->SetReactor(this->reactor.get());
+            this->service.reset(stream_collector);
             break;
+        }
         default:
         std::cout << "Fatal: unknown plugin type" << std::endl;
     }
     builder.reset(new grpc::ServerBuilder());
     builder->AddListeningPort(ss.str(), this->credentials,
                             &this->port);
+
+    configureServer();
+
+    if (this->meta->async_server_enabled &&
+            Proxy::AsyncServer::Supports(plugin->GetType())) {
+        unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+        unsigned int queues = this->meta->completion_queue_count > 0 ?
+                                this->meta->completion_queue_count : cores;
+        this->async_server.reset(new Proxy::AsyncServer(plugin->GetType(),
+                                    service.get(), builder.get(), queues, cores));
+    } else if (this->meta->completion_queue_count > 0) {
+        builder->SetSyncServerOption(grpc::ServerBuilder::SyncServerOption::NUM_CQS,
+                                     this->meta->completion_queue_count);
+    }
+}
+
+void Plugin::GRPCExportImpl::configureServer() {
+    if (meta->max_receive_message_size != 0) {
+        builder->SetMaxReceiveMessageSize(meta->max_receive_message_size);
+    }
+    if (meta->max_send_message_size != 0) {
+        builder->SetMaxSendMessageSize(meta->max_send_message_size);
+    }
+    if (meta->resource_quota_bytes > 0 || meta->resource_quota_max_threads > 0) {
+        grpc::ResourceQuota quota(meta->name);
+        if (meta->resource_quota_bytes > 0) {
+            quota.Resize(meta->resource_quota_bytes);
+        }
+        if (meta->resource_quota_max_threads > 0) {
+            quota.SetMaxThreads(meta->resource_quota_max_threads);
+        }
+        builder->SetResourceQuota(quota);
+    }
+    if (meta->sync_server_max_threads > 0) {
+        builder->SetSyncServerOption(grpc::ServerBuilder::SyncServerOption::MAX_POLLERS,
+                                     meta->sync_server_max_threads);
+    }
+    if (meta->keepalive_time.count() > 0) {
+        builder->AddChannelArgument(GRPC_ARG_KEEPALIVE_TIME_MS,
+                                    static_cast<int>(meta->keepalive_time.count()));
+        builder->AddChannelArgument(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+    }
+    if (meta->keepalive_timeout.count() > 0) {
+        builder->AddChannelArgument(GRPC_ARG_KEEPALIVE_TIMEOUT_MS,
+                                    static_cast<int>(meta->keepalive_timeout.count()));
+    }
 }
 
 void Plugin::GRPCExportImpl::doRegister() {
-    builder->RegisterService(service.get());
+    // The async server registers its own service, and hands the calls over
+    // to the sync one.
+    if (!async_server) {
+        builder->RegisterService(service.get());
+    }
     this->server = std::move(builder->BuildAndStart());
+    if (async_server) {
+        async_server->Start(this->server.get());
+    }
+}
+
+void Plugin::GRPCExportImpl::doStartReactor() {
+    // Sources are registered before the reactor runs, so the plugin needs
+    // no locking against its callbacks there.
+    plugin->start_events(*reactor);
+    reactor->start();
 }
 
 json Plugin::GRPCExportImpl::printPreamble() {
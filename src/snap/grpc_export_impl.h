@@ -25,6 +25,8 @@ limitations under the License.
 
 #include "snap/config.h"
 #include "snap/metric.h"
+#include "snap/proxy/async_server.h"
+#include "snap/reactor.h"
 
 namespace spd = spdlog;
 #define RPC_VERSION 1
@@ -45,20 +47,35 @@ namespace Plugin {
           _logger = spdlog::stderr_logger_mt("gprcExportImpl");
         }
 
+        ~GRPCExportImpl () {
+          // No plugin callback may run while the service is torn down
+          if (reactor)
+            reactor->stop();
+        }
+
     protected:
         int port;
         std::shared_ptr<PluginInterface> plugin;
         const Meta* meta;
         std::shared_ptr<grpc::ServerCredentials> credentials;
+        // declared before service, so that it outlives the proxies using it,
+        // but stopped first by the destructor
+        std::unique_ptr<Reactor> reactor;
         std::unique_ptr<grpc::Service> service;
         std::unique_ptr<grpc::ServerBuilder> builder;
         std::unique_ptr<grpc::Server> server;
+        // declared after server, so that it is shut down first
+        std::unique_ptr<Proxy::AsyncServer> async_server;
 
         std::shared_ptr<grpc::ServerCredentials> configureCredentials();
 
         /* steps of the export procedure */
         void doConfigure();
+        /* applies the server options of meta to builder */
+        void configureServer();
         void doRegister();
+        /* lets the plugin register its event sources, and starts the reactor */
+        void doStartReactor();
         nlohmann::json printPreamble();
 
         /* blocking method - waits for the server to finish. */
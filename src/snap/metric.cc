@@ -13,8 +13,11 @@ limitations under the License.
 */
 #include "snap/metric.h"
 
+#include <cstdint>
+#include <mutex>
 #include <ratio>
 #include <sstream>
+#include <unordered_map>
 
 #include <google/protobuf/repeated_field.h>
 
@@ -24,35 +27,37 @@ using std::chrono::duration_cast;
 using std::chrono::nanoseconds;
 using std::chrono::seconds;
 
+using google::protobuf::Arena;
 using google::protobuf::Map;
 using google::protobuf::RepeatedPtrField;
 
+using Plugin::Clock;
 using Plugin::Metric;
 using Plugin::Namespace;
 using Plugin::NamespaceElement;
+using Plugin::NamespaceElementView;
+using Plugin::NamespaceView;
+using Plugin::StringPool;
 
 Metric::Metric() : delete_metric_ptr(true),
-                rpc_metric_ptr(new rpc::Metric),
-                type(DataType::NotSet),
-                config(Config(const_cast<rpc::ConfigMap&>(rpc_metric_ptr->config()))) {}
+                rpc_metric_ptr(new rpc::Metric) {}
+
+Metric::Metric(Arena* arena) : delete_metric_ptr(arena == nullptr),
+                rpc_metric_ptr(Arena::CreateMessage<rpc::Metric>(arena)) {}
 
 Metric::Metric(Namespace &ns, std::string unit,
-            std::string description) :
-                delete_metric_ptr(true),
-                type(DataType::NotSet),
-                rpc_metric_ptr(new rpc::Metric),
-                config(Config(const_cast<rpc::ConfigMap&>(rpc_metric_ptr->config()))) {
+            std::string description, Arena* arena) :
+                delete_metric_ptr(arena == nullptr),
+                rpc_metric_ptr(Arena::CreateMessage<rpc::Metric>(arena)) {
     rpc_metric_ptr->set_unit(unit);
     rpc_metric_ptr->set_description(description);
     set_ns(ns);
 }
 
 Metric::Metric(Namespace &&ns, std::string unit,
-            std::string description) :
-                delete_metric_ptr(true),
-                type(DataType::NotSet),
-                rpc_metric_ptr(new rpc::Metric),
-                config(Config(const_cast<rpc::ConfigMap&>(rpc_metric_ptr->config()))) {
+            std::string description, Arena* arena) :
+                delete_metric_ptr(arena == nullptr),
+                rpc_metric_ptr(Arena::CreateMessage<rpc::Metric>(arena)) {
     rpc_metric_ptr->set_unit(unit);
     rpc_metric_ptr->set_description(description);
     set_ns(ns);
@@ -60,16 +65,40 @@ Metric::Metric(Namespace &&ns, std::string unit,
 
 Metric::Metric(rpc::Metric* metric) :
                 rpc_metric_ptr(metric),
-                type(DataType::NotSet),
-                delete_metric_ptr(false),
-                config(Config(const_cast<rpc::ConfigMap&>(rpc_metric_ptr->config()))) {}
+                delete_metric_ptr(false) {}
 
-Metric::Metric(const Metric& from) : delete_metric_ptr(true),
-                                    config(from.config) {
+Metric::Metric(const Metric& from) : delete_metric_ptr(true) {
     rpc_metric_ptr = new rpc::Metric;
     *rpc_metric_ptr = *from.rpc_metric_ptr;
 }
 
+Metric::Metric(Metric&& from) noexcept :
+                rpc_metric_ptr(from.rpc_metric_ptr),
+                delete_metric_ptr(from.delete_metric_ptr) {
+    from.rpc_metric_ptr = nullptr;
+    from.delete_metric_ptr = false;
+}
+
+Metric& Metric::operator=(const Metric& from) {
+    if (this != &from) {
+        *this = Metric(from);
+    }
+    return *this;
+}
+
+Metric& Metric::operator=(Metric&& from) noexcept {
+    if (this != &from) {
+        if (delete_metric_ptr) {
+            delete rpc_metric_ptr;
+        }
+        rpc_metric_ptr = from.rpc_metric_ptr;
+        delete_metric_ptr = from.delete_metric_ptr;
+        from.rpc_metric_ptr = nullptr;
+        from.delete_metric_ptr = false;
+    }
+    return *this;
+}
+
 Metric::~Metric() {
     if (delete_metric_ptr) {
         delete rpc_metric_ptr;
@@ -77,59 +106,54 @@ Metric::~Metric() {
 }
 
 void Metric::set_ns(Namespace &ns) {
-    memo_ns.clear();
     rpc_metric_ptr->clear_namespace_();
+    rpc_metric_ptr->mutable_namespace_()->Reserve(ns.size());
 
     for ( int i = 0 ; i < ns.size() ; i++) {
         rpc::NamespaceElement* rpc_elem = rpc_metric_ptr->add_namespace_();
         rpc_elem->set_name(ns[i].get_name());
         rpc_elem->set_value(ns[i].get_value());
         rpc_elem->set_description(ns[i].get_description());
-        memo_ns.push_back({
-            rpc_elem->value(),
-            rpc_elem->name(),
-            rpc_elem->description()
-        });
     }
 }
 
 void Metric::set_diagnostic_config(const Config& cfg) {
-    this->config = cfg;
+    Config config(*rpc_metric_ptr->mutable_config());
+    config = cfg;
 }
 
-const Namespace& Metric::ns() const {
-    if (memo_ns.size() != 0) {
-        return memo_ns;
-    }
+Plugin::NamespaceView Metric::ns() const {
+    return NamespaceView(&rpc_metric_ptr->namespace_());
+}
 
-    RepeatedPtrField<rpc::NamespaceElement> rpc_ns = rpc_metric_ptr->namespace_();
-    memo_ns.reserve(rpc_ns.size());
+void Metric::add_tag(std::pair<std::string, std::string> pair) {
+    Map<std::string, std::string>* rpc_tags = rpc_metric_ptr->mutable_tags();
+    (*rpc_tags)[pair.first] = std::move(pair.second);
+}
 
-    for (rpc::NamespaceElement rpc_elem : rpc_ns) {
-        memo_ns.push_back({
-            rpc_elem.value(),
-            rpc_elem.name(),
-            rpc_elem.description()
-        });
+void Metric::add_tags(const std::map<std::string, std::string>& tags) {
+    Map<std::string, std::string>* rpc_tags = rpc_metric_ptr->mutable_tags();
+    for (const auto& tag : tags) {
+        (*rpc_tags)[tag.first] = tag.second;
     }
-    return memo_ns;
 }
 
-void Metric::add_tag(std::pair<std::string, std::string> pair) {
-    // invalidate memoized tags.
-    std::map<std::string, std::string> memo_tags;
+void Metric::add_tags(const std::vector<std::pair<std::string, std::string>>& tags) {
     Map<std::string, std::string>* rpc_tags = rpc_metric_ptr->mutable_tags();
-    (*rpc_tags)[pair.first] = pair.second;
+    for (const auto& tag : tags) {
+        (*rpc_tags)[tag.first] = tag.second;
+    }
 }
 
-const std::map<std::string, std::string>& Metric::tags() const {
-    if (memo_tags.size() != 0) {
-        return memo_tags;
-    }
-    const Map<std::string, std::string>& rpc_tags = rpc_metric_ptr->tags();
-    memo_tags = std::map<std::string, std::string>(rpc_tags.begin(),
-                                                    rpc_tags.end());
-    return memo_tags;
+const Metric::Tags& Metric::tags() const {
+    return rpc_metric_ptr->tags();
+}
+
+static void to_rpc_time(system_clock::time_point tp, rpc::Time* tm) {
+    uint64_t nanos = uint64_t(duration_cast<nanoseconds>(
+                            tp.time_since_epoch()).count());
+    tm->set_sec(nanos / std::nano::den);
+    tm->set_nsec(nanos % std::nano::den);
 }
 
 /**
@@ -151,8 +175,7 @@ system_clock::time_point Metric::timestamp() const {
 }
 
 void Metric::set_timestamp() {
-    auto now = system_clock::now();
-    set_ts(now);
+    set_ts(Clock::now());
 }
 
 void Metric::set_timestamp(system_clock::time_point tp) {
@@ -160,58 +183,85 @@ void Metric::set_timestamp(system_clock::time_point tp) {
 }
 
 void Metric::set_last_advertised_time() {
-    auto now = system_clock::now();
-    set_last_advert_tm(now);
+    set_last_advert_tm(Clock::now());
 }
 
 void Metric::set_last_advertised_time(system_clock::time_point tp) {
     set_last_advert_tm(tp);
 }
 
+void Metric::set_timestamps(std::vector<Metric>& metrics) {
+    set_timestamps(metrics, Clock::now());
+}
+
+void Metric::set_timestamps(std::vector<Metric>& metrics, system_clock::time_point tp) {
+    rpc::Time tm;
+    to_rpc_time(tp, &tm);
+    for (Metric& metric : metrics) {
+        rpc::Time* metric_tm = metric.rpc_metric_ptr->mutable_timestamp();
+        metric_tm->set_sec(tm.sec());
+        metric_tm->set_nsec(tm.nsec());
+    }
+}
+
+void Metric::set_last_advertised_times(std::vector<Metric>& metrics) {
+    set_last_advertised_times(metrics, Clock::now());
+}
+
+void Metric::set_last_advertised_times(std::vector<Metric>& metrics, system_clock::time_point tp) {
+    rpc::Time tm;
+    to_rpc_time(tp, &tm);
+    for (Metric& metric : metrics) {
+        rpc::Time* metric_tm = metric.rpc_metric_ptr->mutable_lastadvertisedtime();
+        metric_tm->set_sec(tm.sec());
+        metric_tm->set_nsec(tm.nsec());
+    }
+}
+
 Metric::DataType Metric::data_type() const {
     return (Metric::DataType)rpc_metric_ptr->data_case();
 }
 
 void Metric::set_data(float data) {
-    type = DataType::Float32;
     rpc_metric_ptr->set_float32_data(data);
 }
 
 void Metric::set_data(double data) {
-    type = DataType::Float64;
     rpc_metric_ptr->set_float64_data(data);
 }
 
 void Metric::set_data(int32_t data) {
-  type = DataType::Int32;
   rpc_metric_ptr->set_int32_data(data);
 }
 
 void Metric::set_data(int64_t data) {
-  type = DataType::Int64;
   rpc_metric_ptr->set_int64_data(data);
 }
 
 void Metric::set_data(uint32_t data) {
-  type = DataType::Uint32;
   rpc_metric_ptr->set_uint32_data(data);
 }
 
 void Metric::set_data(uint64_t data) {
-  type = DataType::Uint64;
   rpc_metric_ptr->set_uint64_data(data);
 }
 
 void Metric::set_data(bool data) {
-  type = DataType::Bool;
   rpc_metric_ptr->set_bool_data(data);
 }
 
 void Metric::set_data(const std::string& data) {
-    type = DataType::String;
     rpc_metric_ptr->set_string_data(data);
 }
 
+void Metric::set_bytes_data(const std::string& data) {
+    rpc_metric_ptr->set_bytes_data(data);
+}
+
+void Metric::set_bytes_data(const void* data, size_t size) {
+    rpc_metric_ptr->set_bytes_data(data, size);
+}
+
 int32_t Metric::get_int_data() const {
   return rpc_metric_ptr->int32_data();
 }
@@ -244,66 +294,220 @@ const std::string& Metric::get_string_data() const {
     return rpc_metric_ptr->string_data();
 }
 
+const std::string& Metric::get_bytes_data() const {
+    return rpc_metric_ptr->bytes_data();
+}
+
 Plugin::Config Metric::get_config() const {
-    return config;
+    return Config(const_cast<rpc::ConfigMap&>(rpc_metric_ptr->config()));
 }
 
 rpc::Metric* Metric::get_rpc_metric_ptr() const {
     return rpc_metric_ptr;
 }
 
+Arena* Metric::get_arena() const {
+    return rpc_metric_ptr->GetArena();
+}
+
+bool Metric::owns_rpc_metric_ptr() const {
+    return delete_metric_ptr;
+}
+
+rpc::Metric* Metric::release_rpc_metric_ptr() {
+    delete_metric_ptr = false;
+    return rpc_metric_ptr;
+}
+
 void Metric::set_ts(system_clock::time_point tp) {
-    rpc::Time* tm = rpc_metric_ptr->mutable_timestamp();
-    uint64_t nanos = uint64_t(duration_cast<nanoseconds>(
-                            tp.time_since_epoch()).count());
-    tm->set_sec(nanos / std::nano::den);
-    tm->set_nsec(nanos % std::nano::den);
+    to_rpc_time(tp, rpc_metric_ptr->mutable_timestamp());
 }
 
 void Metric::Metric::set_last_advert_tm(system_clock::time_point tp) {
-    rpc::Time* tm = rpc_metric_ptr->mutable_lastadvertisedtime();
-    uint64_t nanos = uint64_t(duration_cast<nanoseconds>(
-                            tp.time_since_epoch()).count());
-    tm->set_sec(nanos / std::nano::den);
-    tm->set_nsec(nanos % std::nano::den);
+    to_rpc_time(tp, rpc_metric_ptr->mutable_lastadvertisedtime());
 }
 
 Namespace::Namespace(std::vector<std::string> ns) {
+    this->namespace_elements.reserve(ns.size());
     for (auto &string_iterator : ns){
-        this->namespace_elements.push_back(NamespaceElement(string_iterator));
+        this->namespace_elements.emplace_back(std::move(string_iterator));
     }
 }
 
 Namespace::Namespace(){}
 
+Namespace::Namespace(const Namespace& from) :
+                    namespace_elements(from.namespace_elements) {
+    if (from.memo_valid.load(std::memory_order_acquire)) {
+        memo_key = from.memo_key;
+        memo_hash = from.memo_hash;
+        memo_valid.store(true, std::memory_order_relaxed);
+    }
+}
+
+Namespace::Namespace(Namespace&& from) noexcept :
+                    namespace_elements(std::move(from.namespace_elements)),
+                    memo_key(std::move(from.memo_key)),
+                    memo_hash(from.memo_hash),
+                    memo_valid(from.memo_valid.load(std::memory_order_relaxed)) {
+    from.invalidate();
+}
+
+Namespace& Namespace::operator=(const Namespace& from) {
+    if (this != &from) {
+        namespace_elements = from.namespace_elements;
+        bool valid = from.memo_valid.load(std::memory_order_acquire);
+        if (valid) {
+            memo_key = from.memo_key;
+            memo_hash = from.memo_hash;
+        }
+        memo_valid.store(valid, std::memory_order_relaxed);
+    }
+    return *this;
+}
+
+Namespace& Namespace::operator=(Namespace&& from) noexcept {
+    if (this != &from) {
+        namespace_elements = std::move(from.namespace_elements);
+        memo_key = std::move(from.memo_key);
+        memo_hash = from.memo_hash;
+        memo_valid.store(from.memo_valid.load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+        from.invalidate();
+    }
+    return *this;
+}
+
 Namespace::~Namespace(){}
 
-const NamespaceElement Namespace::operator[] (int index) const {
+const NamespaceElement& Namespace::operator[] (int index) const {
     return namespace_elements[index];
 }
 
 NamespaceElement& Namespace::operator[] (int index) {
+    invalidate();
     return namespace_elements[index];
 }
 
-const std::string Namespace::get_string() const {
-    std::stringstream ss;
-    int i = 1;
+/**
+* The namespace hash is the 64-bit FNV-1a hash of its canonical key, fed one
+* element at a time so it can be computed without building the key.
+*/
+static const uint64_t fnv_offset_basis = 14695981039346656037ULL;
+static const uint64_t fnv_prime = 1099511628211ULL;
+
+static inline uint64_t fnv1a(uint64_t hash, const std::string& str) {
+    for (unsigned char c : str) {
+        hash ^= c;
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+/**
+* memo_mutex returns the lock guarding the memo of the namespace at ns.
+* Namespaces share a few striped locks, so they stay cheap to create and
+* copy; the lock is only taken the first time a key is computed.
+*/
+static std::mutex& memo_mutex(const void* ns) {
+    static std::mutex stripes[16];
+    return stripes[(reinterpret_cast<uintptr_t>(ns) >> 4) % 16];
+}
+
+void Namespace::memoize() const {
+    std::lock_guard<std::mutex> lock(memo_mutex(this));
+    if (memo_valid.load(std::memory_order_relaxed)) {
+        return;
+    }
+    size_t length = namespace_elements.size();
     for (const auto& node : namespace_elements) {
-        if (i < namespace_elements.size()) ss << node.get_value() << "/";
-        if (i == namespace_elements.size()) ss << node.get_value();
-        i++;
+        length += node.get_value().size();
     }
-    return ss.str();
+    memo_key.clear();
+    memo_key.reserve(length);
+    for (int i = 0; i < namespace_elements.size(); i++) {
+        if (i > 0) memo_key += '/';
+        memo_key += namespace_elements[i].get_value();
+    }
+    memo_hash = fnv1a(fnv_offset_basis, memo_key);
+    memo_valid.store(true, std::memory_order_release);
+}
+
+const std::string& Namespace::get_string() const {
+    if (!memo_valid.load(std::memory_order_acquire)) {
+        memoize();
+    }
+    return memo_key;
+}
+
+uint64_t Namespace::get_hash() const {
+    if (!memo_valid.load(std::memory_order_acquire)) {
+        memoize();
+    }
+    return memo_hash;
+}
+
+/**
+* hash_values hashes the values of elements like the canonical key would be,
+* with the elements at wildcard_indexes (ascending) replaced by "*".
+*/
+template<typename Elements>
+static uint64_t hash_values(const Elements& elements, int size,
+                            const std::vector<int>& wildcard_indexes) {
+    static const std::string separator("/");
+    static const std::string wildcard("*");
+    uint64_t hash = fnv_offset_basis;
+    auto next_wildcard = wildcard_indexes.begin();
+    for (int i = 0; i < size; i++) {
+        if (i > 0) hash = fnv1a(hash, separator);
+        if (next_wildcard != wildcard_indexes.end() && *next_wildcard == i) {
+            hash = fnv1a(hash, wildcard);
+            next_wildcard++;
+        } else {
+            hash = fnv1a(hash, elements[i].get_value());
+        }
+    }
+    return hash;
+}
+
+uint64_t Namespace::get_hash(const std::vector<int>& wildcard_indexes) const {
+    return hash_values(*this, size(), wildcard_indexes);
+}
+
+bool Namespace::operator==(const Namespace& other) const {
+    if (namespace_elements.size() != other.namespace_elements.size()) {
+        return false;
+    }
+    if (memo_valid.load(std::memory_order_acquire) &&
+        other.memo_valid.load(std::memory_order_acquire) &&
+        memo_hash != other.memo_hash) {
+        return false;
+    }
+    for (int i = 0; i < namespace_elements.size(); i++) {
+        if (namespace_elements[i].get_value() != other.namespace_elements[i].get_value()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Namespace::operator!=(const Namespace& other) const {
+    return !(*this == other);
+}
+
+void Namespace::invalidate() {
+    memo_valid.store(false, std::memory_order_relaxed);
 }
 
 Namespace& Namespace::add_static_element(std::string value) {
-    this->namespace_elements.push_back(NamespaceElement(value));
+    invalidate();
+    this->namespace_elements.emplace_back(std::move(value));
     return *this;
 }
 
 Namespace& Namespace::add_dynamic_element(std::string name, std::string description) {
-    this->namespace_elements.push_back(NamespaceElement("*",name,description));
+    invalidate();
+    this->namespace_elements.emplace_back("*", std::move(name), std::move(description));
     return *this;
 }
 
@@ -332,6 +536,7 @@ const std::vector<int> Namespace::get_dynamic_indexes() {
 }
 
 void Namespace::clear() {
+    invalidate();
     this->namespace_elements.clear();
 }
 
@@ -340,53 +545,214 @@ unsigned int Namespace::size() const {
 }
 
 void Namespace::push_back(NamespaceElement& element) {
+    invalidate();
     this->namespace_elements.push_back(element);
 }
 
 void Namespace::push_back(NamespaceElement&& element) {
-    this->namespace_elements.push_back(element);
+    invalidate();
+    this->namespace_elements.push_back(std::move(element));
 }
 
 void Namespace::reserve(unsigned int size) {
     this->namespace_elements.reserve(size);
 }
 
+/**
+* intern returns the pooled copy of a static value, name or description. They
+* repeat across the metrics of a plugin, so each thread remembers the ones it
+* interned, and only takes the lock of the global pool for new ones.
+*/
+static const std::string* intern(std::string&& str) {
+    if (str.empty()) {
+        return StringPool::empty();
+    }
+    thread_local std::unordered_map<std::string, const std::string*> interned;
+    auto it = interned.find(str);
+    if (it != interned.end()) {
+        return it->second;
+    }
+    const std::string* pooled = StringPool::global().intern(str);
+    interned.emplace(std::move(str), pooled);
+    return pooled;
+}
+
 NamespaceElement::NamespaceElement(std::string value, std::string name, std::string description) :
-                                   value(value),
-                                   name(name),
-                                   description(description) {}
+                                   value(StringPool::empty()),
+                                   name(intern(std::move(name))),
+                                   description(intern(std::move(description))) {
+    set_value(std::move(value));
+}
 
 NamespaceElement::NamespaceElement() :
-                                   value(""),
-                                   name(""),
-                                   description("") {}
+                                   value(StringPool::empty()),
+                                   name(StringPool::empty()),
+                                   description(StringPool::empty()) {}
 
 NamespaceElement::~NamespaceElement() {}
 
 void NamespaceElement::set_value(std::string v) {
-    this->value = v;
+    if (is_dynamic()) {
+        this->dynamic_value = std::move(v);
+    } else {
+        this->value = intern(std::move(v));
+    }
 }
 
 void NamespaceElement::set_name(std::string n) {
-    this->name = n;
+    bool was_dynamic = is_dynamic();
+    this->name = intern(std::move(n));
+    // The value moves to where elements of its kind keep it
+    if (was_dynamic && !is_dynamic()) {
+        this->value = intern(std::move(this->dynamic_value));
+        this->dynamic_value.clear();
+    } else if (!was_dynamic && is_dynamic()) {
+        this->dynamic_value = *this->value;
+        this->value = StringPool::empty();
+    }
 }
 
 void NamespaceElement::set_description(std::string d) {
-    this->description = d;
+    this->description = intern(std::move(d));
 }
 
-const std::string NamespaceElement::get_value() const {
-    return this->value;
+const std::string& NamespaceElement::get_value() const {
+    return is_dynamic() ? this->dynamic_value : *this->value;
 }
 
-const std::string NamespaceElement::get_name() const {
-    return this->name;
+const std::string& NamespaceElement::get_name() const {
+    return *this->name;
 }
 
-const std::string NamespaceElement::get_description() const {
-    return this->description;
+const std::string& NamespaceElement::get_description() const {
+    return *this->description;
 }
 
 const bool NamespaceElement::is_dynamic() const {
-    return (this->name != "");
+    return !this->name->empty();
+}
+
+NamespaceElementView::NamespaceElementView(const rpc::NamespaceElement* element) :
+                                           element(element) {}
+
+const std::string& NamespaceElementView::get_value() const {
+    return element->value();
+}
+
+const std::string& NamespaceElementView::get_name() const {
+    return element->name();
+}
+
+const std::string& NamespaceElementView::get_description() const {
+    return element->description();
+}
+
+const bool NamespaceElementView::is_dynamic() const {
+    return !element->name().empty();
+}
+
+NamespaceElementView::operator NamespaceElement() const {
+    return NamespaceElement(element->value(), element->name(), element->description());
+}
+
+NamespaceView::NamespaceView(const RepeatedPtrField<rpc::NamespaceElement>* elements) :
+                             elements(elements) {}
+
+NamespaceElementView NamespaceView::operator[](int index) const {
+    return NamespaceElementView(&elements->Get(index));
+}
+
+unsigned int NamespaceView::size() const {
+    return elements->size();
+}
+
+std::string NamespaceView::get_string() const {
+    size_t length = elements->size();
+    for (const auto& elem : *elements) {
+        length += elem.value().size();
+    }
+    std::string key;
+    key.reserve(length);
+    for (int i = 0; i < elements->size(); i++) {
+        if (i > 0) key += '/';
+        key += elements->Get(i).value();
+    }
+    return key;
+}
+
+uint64_t NamespaceView::get_hash() const {
+    return hash_values(*this, size(), {});
+}
+
+uint64_t NamespaceView::get_hash(const std::vector<int>& wildcard_indexes) const {
+    return hash_values(*this, size(), wildcard_indexes);
+}
+
+const bool NamespaceView::is_dynamic() const {
+    for (const auto& elem : *elements) {
+        if (!elem.name().empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<int> NamespaceView::get_dynamic_indexes() const {
+    std::vector<int> indexes;
+    for (int i = 0; i < elements->size(); i++) {
+        if (!elements->Get(i).name().empty()) {
+            indexes.push_back(i);
+        }
+    }
+    return indexes;
+}
+
+std::vector<NamespaceElement> NamespaceView::get_namespace_elements() const {
+    std::vector<NamespaceElement> namespace_elements;
+    namespace_elements.reserve(elements->size());
+    for (const auto& elem : *elements) {
+        namespace_elements.emplace_back(elem.value(), elem.name(), elem.description());
+    }
+    return namespace_elements;
+}
+
+NamespaceView::operator Namespace() const {
+    Namespace ns;
+    ns.reserve(elements->size());
+    for (const auto& elem : *elements) {
+        ns.push_back({elem.value(), elem.name(), elem.description()});
+    }
+    return ns;
+}
+
+bool NamespaceView::operator==(const NamespaceView& other) const {
+    if (size() != other.size()) {
+        return false;
+    }
+    for (int i = 0; i < elements->size(); i++) {
+        if (elements->Get(i).value() != other.elements->Get(i).value()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NamespaceView::operator!=(const NamespaceView& other) const {
+    return !(*this == other);
+}
+
+bool NamespaceView::operator==(const Namespace& other) const {
+    if (size() != other.size()) {
+        return false;
+    }
+    for (int i = 0; i < elements->size(); i++) {
+        if (elements->Get(i).value() != other[i].get_value()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NamespaceView::operator!=(const Namespace& other) const {
+    return !(*this == other);
 }
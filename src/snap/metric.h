@@ -13,6 +13,7 @@ limitations under the License.
 */
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <map>
@@ -20,9 +21,14 @@ limitations under the License.
 #include <utility>
 #include <vector>
 
+#include <google/protobuf/arena.h>
+#include <google/protobuf/repeated_field.h>
+
 #include "snap/rpc/plugin.pb.h"
 
+#include "snap/clock.h"
 #include "snap/config.h"
+#include "snap/string_pool.h"
 
 namespace Plugin {
 
@@ -42,6 +48,11 @@ namespace Plugin {
         */
         NamespaceElement();
 
+        NamespaceElement(const NamespaceElement& from) = default;
+        NamespaceElement(NamespaceElement&& from) noexcept = default;
+        NamespaceElement& operator=(const NamespaceElement& from) = default;
+        NamespaceElement& operator=(NamespaceElement&& from) noexcept = default;
+
         /**
         * Default empty destructor.
         */
@@ -55,11 +66,13 @@ namespace Plugin {
         void set_description(std::string d);
 
         /**
-        * Getters for value, name and description
+        * Getters for value, name and description. Static values, names and
+        * descriptions are interned, and stay valid after the element is
+        * modified or destroyed; the value of a dynamic element belongs to it.
         */
-        const std::string get_value() const;
-        const std::string get_name() const;
-        const std::string get_description() const;
+        const std::string& get_value() const;
+        const std::string& get_name() const;
+        const std::string& get_description() const;
 
         /**
         * is_dynamic returns true if the namespace element contains data.  A namespace
@@ -72,19 +85,29 @@ namespace Plugin {
         * value is the static value of this node in a namespace.
         * When a namespace element is _not_ dynamic, value is used. During
         * metric collection, value should contain the static name for this metric.
+        * It's interned in the global StringPool: static values come from the
+        * metric catalog, so the prefixes shared by its metrics are stored once.
+        */
+        const std::string* value;
+        /**
+        * dynamic_value is the value of a dynamic element. It's held inline:
+        * dynamic values (pids, disks, container ids...) are unbounded, so they
+        * must not end up in the never-freed StringPool.
         */
-        std::string value;
+        std::string dynamic_value;
         /**
         * name is used to describe what this dynamic element is querying against.
         * E.g. in the namespace `/intel/kvm/[vm_id]/cpu_wait` the element at index
-        * 2 has the name "vm_id".
+        * 2 has the name "vm_id". Like the static value, it's interned, so copying
+        * an element never touches the pool.
         * @see value
         */
-        std::string name;
+        const std::string* name;
         /**
-        * description is the description of this namespace element.
+        * description is the description of this namespace element, interned
+        * as well.
         */
-        std::string description;
+        const std::string* description;
 
     };
 
@@ -101,6 +124,11 @@ namespace Plugin {
         */
         Namespace();
 
+        Namespace(const Namespace& from);
+        Namespace(Namespace&& from) noexcept;
+        Namespace& operator=(const Namespace& from);
+        Namespace& operator=(Namespace&& from) noexcept;
+
         /**
         * Default empty destructor.
         */
@@ -110,12 +138,42 @@ namespace Plugin {
         * Overloaded range operators. They return "NamespaceElement" object
         * from given index.
         */
-        const NamespaceElement operator[] (int index) const;
+        const NamespaceElement& operator[] (int index) const;
+
+        /**
+        * get_string returns the canonical key of the namespace: the values of
+        * its elements joined with "/". It is computed once and cached until
+        * the namespace is modified. Concurrent calls on a const namespace are
+        * safe.
+        */
+        const std::string& get_string() const;
 
-        const std::string get_string() const;
+        /**
+        * get_hash returns a 64-bit hash of the canonical key (@see get_string),
+        * cached the same way.
+        */
+        uint64_t get_hash() const;
 
+        /**
+        * get_hash returns the hash the namespace would have if the elements at
+        * the given (ascending) indexes were "*", without modifying it. It's
+        * used to match namespaces against dynamic ones.
+        */
+        uint64_t get_hash(const std::vector<int>& wildcard_indexes) const;
+
+        /**
+        * Non-const range operator. It invalidates the cached key and hash, so
+        * the returned reference must not be kept across get_string() or
+        * get_hash() calls.
+        */
         NamespaceElement& operator[] (int index);
 
+        /**
+        * Namespaces are equal when the values of their elements are.
+        */
+        bool operator==(const Namespace& other) const;
+        bool operator!=(const Namespace& other) const;
+
         /**
         *  add_static_element adds a static element to the Namespace.  A static
         *  namespaceElement is defined by having an empty Name field.
@@ -180,8 +238,90 @@ namespace Plugin {
         */
         std::vector<NamespaceElement> namespace_elements;
 
+        void inline invalidate();
+        void memoize() const;
+
+        // memoized members, written once under a lock by the first reader
+        // and published through memo_valid
+        mutable std::string memo_key;
+        mutable uint64_t memo_hash = 0;
+        mutable std::atomic<bool> memo_valid{false};
+    };
+
+
+    /**
+    * NamespaceElementView is a read-only NamespaceElement reading straight
+    * from a metric's `rpc::NamespaceElement`. It's only valid as long as the
+    * metric it was obtained from isn't modified or destroyed.
+    */
+    class NamespaceElementView final {
+        public:
+        explicit NamespaceElementView(const rpc::NamespaceElement* element);
+
+        const std::string& get_value() const;
+        const std::string& get_name() const;
+        const std::string& get_description() const;
+
+        /**
+        * @see NamespaceElement::is_dynamic
+        */
+        const bool is_dynamic() const;
+
+        /**
+        * Copies the element out of the metric.
+        */
+        operator NamespaceElement() const;
+
+        private:
+        const rpc::NamespaceElement* element;
     };
 
+    /**
+    * NamespaceView is a read-only Namespace reading straight from a metric's
+    * `rpc::NamespaceElement`s, so that looking at a metric's namespace
+    * doesn't copy it. It's only valid as long as the metric it was obtained
+    * from isn't modified or destroyed: convert it to a Namespace to keep it.
+    */
+    class NamespaceView final {
+        public:
+        explicit NamespaceView(
+            const google::protobuf::RepeatedPtrField<rpc::NamespaceElement>* elements);
+
+        NamespaceElementView operator[] (int index) const;
+
+        unsigned int size() const;
+
+        /**
+        * @see Namespace::get_string
+        * Unlike Namespace, the key is built on each call.
+        */
+        std::string get_string() const;
+
+        /**
+        * get_hash returns the same hash as Namespace::get_hash, without
+        * building the key.
+        */
+        uint64_t get_hash() const;
+        uint64_t get_hash(const std::vector<int>& wildcard_indexes) const;
+
+        const bool is_dynamic() const;
+        const std::vector<int> get_dynamic_indexes() const;
+
+        std::vector<NamespaceElement> get_namespace_elements() const;
+
+        /**
+        * Copies the namespace out of the metric.
+        */
+        operator Namespace() const;
+
+        bool operator==(const NamespaceView& other) const;
+        bool operator!=(const NamespaceView& other) const;
+        bool operator==(const Namespace& other) const;
+        bool operator!=(const Namespace& other) const;
+
+        private:
+        const google::protobuf::RepeatedPtrField<rpc::NamespaceElement>* elements;
+    };
 
     /**
     * Metric is the representation of a Metric inside Snap.
@@ -198,6 +338,7 @@ namespace Plugin {
             Uint32 = rpc::Metric::DataCase::kUint32Data,
             Uint64 = rpc::Metric::DataCase::kUint64Data,
             Bool = rpc::Metric::DataCase::kBoolData,
+            Bytes = rpc::Metric::DataCase::kBytesData,
             NotSet = rpc::Metric::DataCase::DATA_NOT_SET,
         };
 
@@ -211,26 +352,60 @@ namespace Plugin {
                 case Uint32 : lhs << "uint32"; break;
                 case Uint64 : lhs << "uint64"; break;
                 case Bool : lhs << "bool"; break;
+                case Bytes : lhs << "bytes"; break;
                 default : lhs << "notset"; break;
             }
             return lhs;
         }
 
+        /**
+        * BytesData is given to visitors (@see visit) for a bytes datapoint,
+        * to tell it apart from a string one.
+        */
+        struct BytesData {
+            const std::string& data;
+
+            friend std::ostream& operator<<(std::ostream& lhs, const BytesData& bytes) {
+                return lhs << bytes.data;
+            }
+        };
+
+        /**
+        * NoData is given to visitors (@see visit) when no datapoint is set.
+        */
+        struct NoData {
+            friend std::ostream& operator<<(std::ostream& lhs, const NoData&) {
+                return lhs;
+            }
+        };
+
         Metric();
+
+        /**
+        * Constructor allocating the underlying rpc::Metric (and its namespace,
+        * timestamps and tags) out of the given arena instead of the heap.
+        * The arena must outlive the metric, and the metric never deletes
+        * arena memory.
+        */
+        explicit Metric(google::protobuf::Arena* arena);
+
         /**
         * The typical metric constructor.
         * @param ns The metric's namespace.
         * @param unit The metric's unit.
         * @param description The metric's description.
+        * @param arena The arena to allocate from (optional- heap by default).
         */
         Metric(Namespace &ns, std::string unit,
-                std::string description);
+                std::string description,
+                google::protobuf::Arena* arena = nullptr);
 
         /**
         * Constructor same as above but takes lvalue of "Namespace"
         */
         Metric(Namespace &&ns, std::string unit,
-                std::string description);
+                std::string description,
+                google::protobuf::Arena* arena = nullptr);
 
         /**
         * This constructor is used in the plugin proxies.
@@ -241,44 +416,60 @@ namespace Plugin {
 
         Metric(const Metric& from);
 
+        /**
+        * Move constructor. It steals the underlying rpc::Metric (and its
+        * ownership) from the moved metric. The moved metric may only be
+        * destroyed or assigned to.
+        */
+        Metric(Metric&& from) noexcept;
+
+        Metric& operator=(const Metric& from);
+        Metric& operator=(Metric&& from) noexcept;
+
         ~Metric();
 
         /**
-        * ns returns the metric's namespace.
-        * If there is a memoized copy, that is returned. Else the namespace is
-        * copied into the cache then returned.
+        * ns returns a view of the metric's namespace, reading the elements
+        * from the `rpc::Metric` ptr on demand.
+        * @see NamespaceView
         */
-        const Namespace& ns() const;
+        NamespaceView ns() const;
 
         /**
         * set_ns sets the namespace of the metric in its `rpc::Metric` ptr.
-        * It also invalidates the memoization cache of the namespace if it is
-        * present.
-        * @see memo_ns
         */
         void set_ns(Namespace &ns);
 
+        /**
+        * Tags is a read-only view of the metric's tags: the map of the
+        * underlying `rpc::Metric` itself, so reading it copies nothing.
+        */
+        typedef google::protobuf::Map<std::string, std::string> Tags;
+
         /**
         * tags returns the metric's tags.
-        * If there is a memoized copy, that is returned. Else the tags are copied
-        * into the cache then returned.
         */
-        const std::map<std::string, std::string>& tags() const;
+        const Tags& tags() const;
 
         /**
-        * set_ns adds tags to the metric in its `rpc::Metric` ptr.
-        * It also invalidates the memoization cache of the tags if it is
-        * present.
-        * @see memo_tags_ptr
+        * add_tag adds a tag to the metric in its `rpc::Metric` ptr, replacing
+        * the value of a tag with the same key.
         */
         void add_tag(std::pair<std::string, std::string>);
 
+        /**
+        * add_tags adds several tags at once, same as add_tag.
+        */
+        void add_tags(const std::map<std::string, std::string>& tags);
+        void add_tags(const std::vector<std::pair<std::string, std::string>>& tags);
+
         /**
         * timestamp returns the metric's collection timestamp.
         */
         std::chrono::system_clock::time_point timestamp() const;
         /**
         * set_timestamp sets the timestamp as now.
+        * @see Clock
         */
         void set_timestamp();
 
@@ -299,6 +490,22 @@ namespace Plugin {
         */
         void set_last_advertised_time(std::chrono::system_clock::time_point tp);
 
+        /**
+        * set_timestamps sets the timestamp of all the metrics as now, reading
+        * the clock only once.
+        */
+        static void set_timestamps(std::vector<Metric>& metrics);
+        static void set_timestamps(std::vector<Metric>& metrics,
+                                   std::chrono::system_clock::time_point tp);
+
+        /**
+        * set_last_advertised_times sets the last_advertised_time of all the
+        * metrics as now, reading the clock only once.
+        */
+        static void set_last_advertised_times(std::vector<Metric>& metrics);
+        static void set_last_advertised_times(std::vector<Metric>& metrics,
+                                              std::chrono::system_clock::time_point tp);
+
         /**
         * set_diagnostic_config is used to apply generated config to specific metric.
         */
@@ -319,6 +526,13 @@ namespace Plugin {
         void set_data(bool data);
         void set_data(const std::string& data);
 
+        /**
+        * set_bytes_data sets a binary datapoint, as opposed to set_data which
+        * sets a string one.
+        */
+        void set_bytes_data(const std::string& data);
+        void set_bytes_data(const void* data, size_t size);
+
         /**
         * Retrieve this metric's datapoint
         */
@@ -330,22 +544,83 @@ namespace Plugin {
         double get_float64_data() const;
         bool get_bool_data() const;
         const std::string& get_string_data() const;
+        const std::string& get_bytes_data() const;
+
+        /**
+        * visit calls f once with this metric's datapoint, typed after the
+        * data_type(): int32_t, int64_t, uint32_t, uint64_t, float, double,
+        * bool, const std::string& (String), BytesData (Bytes) or NoData
+        * (NotSet). f is typically a generic lambda or a functor with
+        * overloads, and all of its overloads must return the same type.
+        */
+        template<typename F>
+        auto visit(F&& f) const -> decltype(f(int32_t())) {
+            switch (rpc_metric_ptr->data_case()) {
+                case rpc::Metric::DataCase::kStringData:
+                    return f(rpc_metric_ptr->string_data());
+                case rpc::Metric::DataCase::kFloat32Data:
+                    return f(rpc_metric_ptr->float32_data());
+                case rpc::Metric::DataCase::kFloat64Data:
+                    return f(rpc_metric_ptr->float64_data());
+                case rpc::Metric::DataCase::kInt32Data:
+                    return f(rpc_metric_ptr->int32_data());
+                case rpc::Metric::DataCase::kInt64Data:
+                    return f(rpc_metric_ptr->int64_data());
+                case rpc::Metric::DataCase::kUint32Data:
+                    return f(rpc_metric_ptr->uint32_data());
+                case rpc::Metric::DataCase::kUint64Data:
+                    return f(rpc_metric_ptr->uint64_data());
+                case rpc::Metric::DataCase::kBoolData:
+                    return f(rpc_metric_ptr->bool_data());
+                case rpc::Metric::DataCase::kBytesData:
+                    return f(BytesData{rpc_metric_ptr->bytes_data()});
+                default:
+                    return f(NoData());
+            }
+        }
         Config get_config() const;
         rpc::Metric* get_rpc_metric_ptr() const;
 
+        /**
+        * get_arena returns the arena the underlying rpc::Metric was allocated
+        * from, or nullptr when it lives on the heap.
+        */
+        google::protobuf::Arena* get_arena() const;
+
+        /**
+        * owns_rpc_metric_ptr returns true when the underlying rpc::Metric is
+        * deleted together with this metric, false when it is borrowed (e.g.
+        * from an incoming request in the plugin proxies).
+        */
+        bool owns_rpc_metric_ptr() const;
+
+        /**
+        * release_rpc_metric_ptr hands over the ownership of the underlying
+        * rpc::Metric to the caller, so it can be moved into a reply without
+        * being copied. The metric still points to it afterwards, but won't
+        * delete it. Arena allocated metrics are never owned, so they are
+        * copied by protobuf when added to a message living elsewhere.
+        */
+        rpc::Metric* release_rpc_metric_ptr();
+
         private:
+        friend class MetricBatch;
+
         rpc::Metric* rpc_metric_ptr;
-        Config config;
 
         void inline set_ts(std::chrono::system_clock::time_point tp);
         void inline set_last_advert_tm(std::chrono::system_clock::time_point tp);
 
-        // memoized members
-        mutable Namespace memo_ns;
-        mutable std::map<std::string, std::string> memo_tags;
-
         bool delete_metric_ptr;
-        DataType type;
     };
 
 }   // namespace Plugin
+
+namespace std {
+    template<>
+    struct hash<Plugin::Namespace> {
+        size_t operator()(const Plugin::Namespace& ns) const {
+            return ns.get_hash();
+        }
+    };
+}   // namespace std
@@ -0,0 +1,112 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/metric_batch.h"
+
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+
+using std::chrono::system_clock;
+using std::string;
+using std::vector;
+
+using Plugin::Clock;
+using Plugin::Metric;
+using Plugin::MetricBatch;
+using Plugin::PluginException;
+
+MetricBatch::MetricBatch(const Metric& prototype, int dynamic_index) :
+                _prototype(*prototype.get_rpc_metric_ptr()),
+                _dynamic_index(dynamic_index) {
+    _prototype.clear_data();
+
+    if (_dynamic_index < 0) {
+        for (int i = 0; i < _prototype.namespace__size(); i++) {
+            if (!_prototype.namespace_(i).name().empty()) {
+                _dynamic_index = i;
+                break;
+            }
+        }
+    }
+    if (_dynamic_index < 0 || _dynamic_index >= _prototype.namespace__size()) {
+        throw PluginException("Metric batch prototype has no dynamic element");
+    }
+}
+
+Metric MetricBatch::add(const string& dynamic_value) {
+    rpc::Metric* rpc_metric = _metrics.Add();
+    *rpc_metric = _prototype;
+    rpc_metric->mutable_namespace_(_dynamic_index)->set_value(dynamic_value);
+    return Metric(rpc_metric);
+}
+
+void MetricBatch::set_timestamp() {
+    set_timestamp(Clock::now());
+}
+
+void MetricBatch::set_timestamp(system_clock::time_point tp) {
+    for (rpc::Metric& rpc_metric : _metrics) {
+        Metric(&rpc_metric).set_timestamp(tp);
+    }
+}
+
+void MetricBatch::reserve(int count) {
+    _metrics.Reserve(count);
+}
+
+void MetricBatch::clear() {
+    _metrics.Clear();
+}
+
+int MetricBatch::size() const {
+    return _metrics.size();
+}
+
+int MetricBatch::dynamic_index() const {
+    return _dynamic_index;
+}
+
+void MetricBatch::move_to(vector<Metric>& metrics) {
+    vector<rpc::Metric*> released;
+    extract(released);
+
+    metrics.reserve(metrics.size() + released.size());
+    for (rpc::Metric* rpc_metric : released) {
+        Metric metric(rpc_metric);
+        metric.delete_metric_ptr = true;
+        metrics.push_back(std::move(metric));
+    }
+}
+
+void MetricBatch::move_to(rpc::MetricsReply* reply) {
+    if (reply->metrics_size() == 0) {
+        reply->mutable_metrics()->Swap(&_metrics);
+        _metrics.Clear();
+        return;
+    }
+
+    vector<rpc::Metric*> released;
+    extract(released);
+
+    reply->mutable_metrics()->Reserve(reply->metrics_size() + released.size());
+    for (rpc::Metric* rpc_metric : released) {
+        reply->mutable_metrics()->AddAllocated(rpc_metric);
+    }
+}
+
+void MetricBatch::extract(vector<rpc::Metric*>& released) {
+    released.resize(_metrics.size());
+    _metrics.ExtractSubrange(0, _metrics.size(), released.data());
+}
@@ -0,0 +1,118 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/repeated_field.h>
+
+#include "snap/rpc/plugin.pb.h"
+
+#include "snap/metric.h"
+
+namespace Plugin {
+    /**
+    * MetricBatch stamps out metrics that only differ by one dynamic element
+    * of their namespace and by their value (e.g. one metric per CPU or per
+    * disk).
+    *
+    * The prototype metric (namespace, unit, description, tags, config) is
+    * serialized once; every added metric is a protobuf copy of it with the
+    * dynamic element value and the data set. Metrics are built in place in
+    * protobuf messages which are then moved, not copied, into the caller's
+    * vector or reply.
+    */
+    class MetricBatch final {
+    public:
+        /**
+        * @param prototype the metric every added metric is copied from. Its
+        * data is not copied.
+        * @param dynamic_index the index of the namespace element set by add.
+        * When negative, the first dynamic element of the prototype is used.
+        * @throws PluginException when there is no such element.
+        */
+        explicit MetricBatch(const Metric& prototype, int dynamic_index = -1);
+
+        MetricBatch(const MetricBatch&) = delete;
+        MetricBatch& operator=(const MetricBatch&) = delete;
+
+        /**
+        * add appends a copy of the prototype, with the dynamic element set to
+        * dynamic_value.
+        * The returned metric points into this batch: it is only valid until
+        * the batch is moved out, cleared or destroyed.
+        */
+        Metric add(const std::string& dynamic_value);
+
+        /**
+        * add appends a copy of the prototype, with the dynamic element set to
+        * dynamic_value and its data set to value.
+        * @see add(const std::string&)
+        */
+        template<typename T>
+        Metric add(const std::string& dynamic_value, const T& value) {
+            Metric metric = add(dynamic_value);
+            metric.set_data(value);
+            return metric;
+        }
+
+        /**
+        * set_timestamp sets the timestamp of the metrics added so far as now,
+        * reading the clock only once.
+        * @see Clock
+        */
+        void set_timestamp();
+        void set_timestamp(std::chrono::system_clock::time_point tp);
+
+        /**
+        * reserve makes room for count metrics.
+        */
+        void reserve(int count);
+
+        /**
+        * clear drops the metrics added so far. Their messages are kept to be
+        * reused by the next calls to add.
+        */
+        void clear();
+
+        int size() const;
+
+        /**
+        * dynamic_index returns the index of the namespace element set by add.
+        */
+        int dynamic_index() const;
+
+        /**
+        * move_to appends the metrics added so far to metrics, which then own
+        * them, and empties the batch.
+        */
+        void move_to(std::vector<Metric>& metrics);
+
+        /**
+        * move_to appends the metrics added so far to reply and empties the
+        * batch.
+        */
+        void move_to(rpc::MetricsReply* reply);
+
+    private:
+        void extract(std::vector<rpc::Metric*>& released);
+
+        rpc::Metric _prototype;
+        int _dynamic_index;
+        google::protobuf::RepeatedPtrField<rpc::Metric> _metrics;
+    };
+
+}   // namespace Plugin
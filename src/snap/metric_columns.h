@@ -0,0 +1,186 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "snap/metric.h"
+#include "snap/metric_batch.h"
+#include "snap/plugin.h"
+
+namespace Plugin {
+    /**
+    * MetricColumns holds a homogeneous numeric series (e.g. one counter per
+    * core) column by column: the metric shared by the whole series, then one
+    * contiguous vector each for the dynamic element values, the timestamps
+    * and the values.
+    *
+    * T is one of int32_t, int64_t, uint32_t, uint64_t, float or double.
+    */
+    template<typename T>
+    class MetricColumns final {
+        static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                      "MetricColumns only holds numeric data");
+
+    public:
+        /**
+        * @param prototype the metric shared by the series: namespace, unit,
+        * description, tags and config. Its data and timestamp are ignored.
+        * @param dynamic_index the index of the namespace element varying
+        * across the series. When negative, the first dynamic element of the
+        * prototype is used.
+        * @throws PluginException when there is no such element.
+        */
+        explicit MetricColumns(const Metric& prototype, int dynamic_index = -1) :
+                        _batch(new MetricBatch(prototype, dynamic_index)),
+                        _prototype(prototype),
+                        _dynamic_index(_batch->dynamic_index()) {}
+
+        /**
+        * from_metrics builds the columns of metrics, which must all fit the
+        * first one (@see append).
+        * @throws PluginException when metrics is empty or does not fit.
+        */
+        static MetricColumns from_metrics(const std::vector<Metric>& metrics,
+                                          int dynamic_index = -1) {
+            if (metrics.empty()) {
+                throw PluginException("No metrics to build columns from");
+            }
+            MetricColumns columns(metrics.front(), dynamic_index);
+            columns.reserve(metrics.size());
+            for (const Metric& metric : metrics) {
+                if (!columns.append(metric)) {
+                    throw PluginException("Metric " + metric.ns().get_string() +
+                                          " does not fit the columns");
+                }
+            }
+            return columns;
+        }
+
+        void push_back(const std::string& dynamic_value, T value,
+                       std::chrono::system_clock::time_point timestamp) {
+            _dynamic_values.push_back(dynamic_value);
+            _values.push_back(value);
+            _timestamps.push_back(timestamp);
+        }
+
+        /**
+        * append adds metric to the columns when it only differs from the
+        * prototype by its dynamic element value, and holds a T.
+        * @return false, leaving the columns untouched, otherwise.
+        */
+        bool append(const Metric& metric) {
+            if (!fits(*metric.get_rpc_metric_ptr())) {
+                return false;
+            }
+            return metric.visit(Appender{this, metric});
+        }
+
+        void reserve(size_t count) {
+            _dynamic_values.reserve(count);
+            _values.reserve(count);
+            _timestamps.reserve(count);
+        }
+
+        void clear() {
+            _dynamic_values.clear();
+            _values.clear();
+            _timestamps.clear();
+        }
+
+        size_t size() const { return _values.size(); }
+
+        const Metric& prototype() const { return _prototype; }
+        int dynamic_index() const { return _dynamic_index; }
+
+        const std::vector<std::string>& dynamic_values() const { return _dynamic_values; }
+        const std::vector<T>& values() const { return _values; }
+        std::vector<T>& values() { return _values; }
+        const std::vector<std::chrono::system_clock::time_point>& timestamps() const {
+            return _timestamps;
+        }
+
+        /**
+        * to_metrics appends one metric per row to metrics.
+        */
+        void to_metrics(std::vector<Metric>& metrics) {
+            _batch->reserve(size());
+            for (size_t i = 0; i < size(); i++) {
+                _batch->add(_dynamic_values[i], _values[i]).set_timestamp(_timestamps[i]);
+            }
+            _batch->move_to(metrics);
+        }
+
+    private:
+        struct Appender {
+            MetricColumns* columns;
+            const Metric& metric;
+
+            bool operator()(const T& value) const {
+                columns->push_back(dynamic_value(), value, metric.timestamp());
+                return true;
+            }
+
+            template<typename U>
+            bool operator()(const U&) const {
+                return false;
+            }
+
+            const std::string& dynamic_value() const {
+                return metric.get_rpc_metric_ptr()->namespace_(
+                    columns->_dynamic_index).value();
+            }
+        };
+
+        bool fits(const rpc::Metric& metric) const {
+            const rpc::Metric& proto = *_prototype.get_rpc_metric_ptr();
+            if (metric.namespace__size() != proto.namespace__size() ||
+                    metric.unit() != proto.unit() ||
+                    metric.description() != proto.description() ||
+                    metric.tags_size() != proto.tags_size()) {
+                return false;
+            }
+            for (int i = 0; i < proto.namespace__size(); i++) {
+                if (i == _dynamic_index) {
+                    if (metric.namespace_(i).name() != proto.namespace_(i).name()) {
+                        return false;
+                    }
+                } else if (metric.namespace_(i).value() != proto.namespace_(i).value()) {
+                    return false;
+                }
+            }
+            for (const auto& tag : proto.tags()) {
+                auto it = metric.tags().find(tag.first);
+                if (it == metric.tags().end() || it->second != tag.second) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::unique_ptr<MetricBatch> _batch;
+        Metric _prototype;
+        int _dynamic_index;
+
+        std::vector<std::string> _dynamic_values;
+        std::vector<T> _values;
+        std::vector<std::chrono::system_clock::time_point> _timestamps;
+    };
+
+}   // namespace Plugin
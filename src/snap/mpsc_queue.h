@@ -0,0 +1,81 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace Plugin {
+    /**
+    * MpscQueue is an unbounded lock-free queue for many producers and a
+    * single consumer, after D. Vyukov's node-based MPSC queue.
+    * push may be called from any thread; pop and empty only from the
+    * consumer thread. A push in progress may not be visible to pop yet, in
+    * which case the queue looks empty until the push completes.
+    * All operations are sequentially consistent, so that a consumer going
+    * to sleep and a producer checking whether to wake it up cannot miss
+    * each other.
+    */
+    template<typename T>
+    class MpscQueue final {
+    public:
+        MpscQueue() : _head(new Node()), _tail(_head.load()) {}
+
+        ~MpscQueue() {
+            T value;
+            while (pop(value)) {}
+            delete _tail;
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        void push(T value) {
+            Node* node = new Node(std::move(value));
+            Node* prev = _head.exchange(node);
+            prev->next.store(node);
+        }
+
+        bool pop(T& value) {
+            Node* tail = _tail;
+            Node* next = tail->next.load();
+            if (next == nullptr) {
+                return false;
+            }
+            value = std::move(next->value);
+            _tail = next;
+            delete tail;
+            return true;
+        }
+
+        bool empty() const {
+            return _tail->next.load() == nullptr;
+        }
+
+    private:
+        struct Node {
+            Node() : next(nullptr) {}
+            explicit Node(T&& value) : value(std::move(value)), next(nullptr) {}
+
+            T value;
+            std::atomic<Node*> next;
+        };
+
+        // Producers append at _head, the consumer pops after _tail, which
+        // is the last node popped (or the initial stub).
+        std::atomic<Node*> _head;
+        Node* _tail;
+    };
+
+}   // namespace Plugin
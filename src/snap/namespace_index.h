@@ -0,0 +1,161 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "snap/metric.h"
+
+namespace Plugin {
+
+    /**
+    * NamespaceIndex maps namespaces defined by a plugin (typically the ones
+    * reported by get_metric_types) to plugin-defined handlers, e.g. the reader
+    * to use for a metric. Lookups are done by namespace hash, so finding the
+    * handler of a requested metric doesn't involve any string matching.
+    *
+    * Elements of a registered namespace whose value is "*" (dynamic elements)
+    * match any value: the handler registered for `intel/procfs/cpu/[cpu_id]/user`
+    * is found both for the requested namespace and for collected ones such as
+    * `intel/procfs/cpu/3/user`.
+    */
+    template<typename T>
+    class NamespaceIndex final {
+    public:
+        /**
+        * add registers handler for the namespace ns. A handler registered
+        * earlier for an equal namespace is replaced.
+        */
+        void add(const Namespace& ns, T handler) {
+            std::vector<int> wildcards;
+            for (int i = 0; i < ns.size(); i++) {
+                if (ns[i].get_value() == "*") wildcards.push_back(i);
+            }
+            uint64_t hash = ns.get_hash();
+            auto range = _entries.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second.ns == ns) {
+                    it->second.handler = std::move(handler);
+                    return;
+                }
+            }
+            _entries.emplace(hash, Entry{ns, std::move(handler)});
+            if (!wildcards.empty()) {
+                Pattern pattern{ns.size(), std::move(wildcards)};
+                if (std::find(_patterns.begin(), _patterns.end(), pattern) == _patterns.end()) {
+                    _patterns.push_back(std::move(pattern));
+                }
+            }
+        }
+
+        /**
+        * find returns the handler registered for ns (exactly, or through
+        * dynamic elements), or nullptr if there is none.
+        */
+        const T* find(const Namespace& ns) const {
+            return lookup(ns);
+        }
+
+        /**
+        * find looks the namespace of a metric up without copying it out of
+        * the metric (@see NamespaceView).
+        */
+        const T* find(const NamespaceView& ns) const {
+            return lookup(ns);
+        }
+
+        T* find(const Namespace& ns) {
+            return const_cast<T*>(lookup(ns));
+        }
+
+        T* find(const NamespaceView& ns) {
+            return const_cast<T*>(lookup(ns));
+        }
+
+        /**
+        * size returns the number of registered namespaces.
+        */
+        size_t size() const {
+            return _entries.size();
+        }
+
+        void clear() {
+            _entries.clear();
+            _patterns.clear();
+        }
+
+    private:
+        struct Entry {
+            Namespace ns;
+            T handler;
+        };
+
+        /**
+        * Pattern describes where the dynamic elements of registered namespaces
+        * of a given size are. Each distinct pattern costs one hash lookup.
+        */
+        struct Pattern {
+            unsigned int size;
+            std::vector<int> wildcards;
+
+            bool operator==(const Pattern& other) const {
+                return size == other.size && wildcards == other.wildcards;
+            }
+        };
+
+        template<typename N>
+        const T* lookup(const N& ns) const {
+            const T* handler = find(ns, ns.get_hash());
+            for (auto it = _patterns.begin(); handler == nullptr && it != _patterns.end(); ++it) {
+                if (it->size == ns.size()) {
+                    handler = find(ns, ns.get_hash(it->wildcards));
+                }
+            }
+            return handler;
+        }
+
+        template<typename N>
+        const T* find(const N& ns, uint64_t hash) const {
+            auto range = _entries.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (matches(it->second.ns, ns)) {
+                    return &it->second.handler;
+                }
+            }
+            return nullptr;
+        }
+
+        template<typename N>
+        static bool matches(const Namespace& registered, const N& ns) {
+            if (registered.size() != ns.size()) {
+                return false;
+            }
+            for (int i = 0; i < ns.size(); i++) {
+                const std::string& value = registered[i].get_value();
+                if (value != "*" && value != ns[i].get_value()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::unordered_multimap<uint64_t, Entry> _entries;
+        std::vector<Pattern> _patterns;
+    };
+
+}   // namespace Plugin
@@ -66,7 +66,19 @@ Plugin::Meta::Meta(Type type, std::string name, int version, RpcType rpc_type) :
                     tls_certificate_authority_paths(""),
                     stand_alone(false),
                     diagnostic_enabled(false),
-                    stand_alone_port(stand_alone_port) {}
+                    stand_alone_port(stand_alone_port),
+                    async_server_enabled(false),
+                    max_receive_message_size(0),
+                    max_send_message_size(0),
+                    resource_quota_bytes(0),
+                    resource_quota_max_threads(0),
+                    sync_server_max_threads(0),
+                    completion_queue_count(0),
+                    keepalive_time(0),
+                    keepalive_timeout(0),
+                    compression_algorithm(GRPC_COMPRESS_NONE),
+                    compression_threshold(0),
+                    clock_source(ClockSource::Precise) {}
 
 void Plugin::Meta::use_cli_args(Flags *flags) {
     listen_port = flags->GetFlagStrValue("port");
@@ -79,6 +91,41 @@ void Plugin::Meta::use_cli_args(Flags *flags) {
     stand_alone = flags->IsParsedFlag("stand-alone");
     stand_alone_port = flags->GetFlagIntValue("stand-alone-port");
     diagnostic_enabled = !stand_alone && !flags->IsConfigFromFramework();
+
+    // Server options are only overridden when given, so that plugins can set
+    // their own defaults.
+    if (flags->IsParsedFlag("async-server"))
+        async_server_enabled = true;
+    if (flags->IsParsedFlag("max-recv-msg-size"))
+        max_receive_message_size = flags->GetFlagIntValue("max-recv-msg-size");
+    if (flags->IsParsedFlag("max-send-msg-size"))
+        max_send_message_size = flags->GetFlagIntValue("max-send-msg-size");
+    if (flags->IsParsedFlag("resource-quota"))
+        resource_quota_bytes = flags->GetFlagInt64Value("resource-quota");
+    if (flags->IsParsedFlag("resource-quota-threads"))
+        resource_quota_max_threads = flags->GetFlagIntValue("resource-quota-threads");
+    if (flags->IsParsedFlag("sync-server-threads"))
+        sync_server_max_threads = flags->GetFlagIntValue("sync-server-threads");
+    if (flags->IsParsedFlag("completion-queues"))
+        completion_queue_count = flags->GetFlagIntValue("completion-queues");
+    if (flags->IsParsedFlag("keepalive-time"))
+        keepalive_time = std::chrono::milliseconds(flags->GetFlagIntValue("keepalive-time"));
+    if (flags->IsParsedFlag("keepalive-timeout"))
+        keepalive_timeout = std::chrono::milliseconds(flags->GetFlagIntValue("keepalive-timeout"));
+    if (flags->IsParsedFlag("compression")) {
+        std::string compression = flags->GetFlagStrValue("compression");
+        if (compression == "none") {
+            compression_algorithm = GRPC_COMPRESS_NONE;
+        } else if (compression == "deflate") {
+            compression_algorithm = GRPC_COMPRESS_DEFLATE;
+        } else if (compression == "gzip") {
+            compression_algorithm = GRPC_COMPRESS_GZIP;
+        } else {
+            throw PluginException("Unknown compression algorithm: " + compression);
+        }
+    }
+    if (flags->IsParsedFlag("compression-threshold"))
+        compression_threshold = flags->GetFlagInt64Value("compression-threshold");
 }
 
 Plugin::CollectorInterface* Plugin::PluginInterface::IsCollector() {
@@ -105,6 +152,23 @@ Plugin::CollectorInterface* Plugin::CollectorInterface::IsCollector() {
     return this;
 }
 
+std::string Plugin::CollectorInterface::partition_key(const Metric& metric) {
+    NamespaceView ns = metric.ns();
+    std::string key;
+    for (int i = 0; i + 1 < ns.size(); i++) {
+        key += ns[i].get_value();
+        key += '/';
+    }
+    return key;
+}
+
+void Plugin::CollectorInterface::SetCollectWorkers(unsigned int collectWorkers) {
+    _collect_workers = collectWorkers;
+}
+unsigned int Plugin::CollectorInterface::GetCollectWorkers() const {
+    return _collect_workers;
+}
+
 Plugin::Type Plugin::ProcessorInterface::GetType() const {
     return Processor;
 }
@@ -129,16 +193,18 @@ Plugin::StreamCollectorInterface* Plugin::StreamCollectorInterface::IsStreamColl
     return this;
 }
 
+void Plugin::StreamCollectorInterface::stream_metrics() {}
+
 
 void Plugin::StreamCollectorInterface::SetMaxCollectDuration(int64_t maxCollectDuration) {
     SetMaxCollectDuration(std::chrono::seconds(maxCollectDuration));
 }
-void Plugin::StreamCollectorInterface::SetMaxCollectDuration(std::chrono::seconds maxCollectDuration) {
+void Plugin::StreamCollectorInterface::SetMaxCollectDuration(std::chrono::nanoseconds maxCollectDuration) {
     _max_collect_duration = maxCollectDuration;
     if (_stream_collector_impl)
         _stream_collector_impl->SetMaxCollectDuration(maxCollectDuration);
 }
-std::chrono::seconds Plugin::StreamCollectorInterface::GetMaxCollectDuration() {
+std::chrono::nanoseconds Plugin::StreamCollectorInterface::GetMaxCollectDuration() {
     return _max_collect_duration;
 }
 
@@ -151,6 +217,56 @@ size_t Plugin::StreamCollectorInterface::GetMaxMetricsBuffer() {
     return _max_metrics_buffer;
 }
 
+void Plugin::StreamCollectorInterface::SetMaxInFlight(size_t maxInFlight) {
+    _max_in_flight = maxInFlight;
+    if (_stream_collector_impl)
+        _stream_collector_impl->SetMaxInFlight(maxInFlight);
+}
+size_t Plugin::StreamCollectorInterface::GetMaxInFlight() {
+    return _max_in_flight;
+}
+
+void Plugin::StreamCollectorInterface::SetCoalesceMetrics(bool coalesceMetrics) {
+    _coalesce_metrics = coalesceMetrics;
+    if (_stream_collector_impl)
+        _stream_collector_impl->SetCoalesceMetrics(coalesceMetrics);
+}
+bool Plugin::StreamCollectorInterface::GetCoalesceMetrics() {
+    return _coalesce_metrics;
+}
+
+void Plugin::StreamCollectorInterface::SetOverflowPolicy(OverflowPolicy overflowPolicy) {
+    _overflow_policy = overflowPolicy;
+    if (_stream_collector_impl)
+        _stream_collector_impl->SetOverflowPolicy(overflowPolicy);
+}
+Plugin::OverflowPolicy Plugin::StreamCollectorInterface::GetOverflowPolicy() {
+    return _overflow_policy;
+}
+
+void Plugin::StreamCollectorInterface::SetOverflowSampleRate(unsigned int overflowSampleRate) {
+    if (overflowSampleRate == 0)
+        throw PluginException("Overflow sample rate must be greater than 0");
+    _overflow_sample_rate = overflowSampleRate;
+    if (_stream_collector_impl)
+        _stream_collector_impl->SetOverflowSampleRate(overflowSampleRate);
+}
+unsigned int Plugin::StreamCollectorInterface::GetOverflowSampleRate() {
+    return _overflow_sample_rate;
+}
+
+uint64_t Plugin::StreamCollectorInterface::dropped_metrics() {
+    if (_stream_collector_impl)
+        return _stream_collector_impl->droppedMetrics();
+    return 0;
+}
+
+bool Plugin::StreamCollectorInterface::would_block() {
+    if (_stream_collector_impl)
+        return _stream_collector_impl->wouldBlock();
+    return false;
+}
+
 
 void Plugin::StreamCollectorInterface::send_metrics(const std::vector<Plugin::Metric>& metrics) {
     if (_stream_collector_impl)
@@ -201,6 +317,7 @@ void Plugin::start_collector(int argc, char **argv, CollectorInterface* collecto
     if (! meta.diagnostic_enabled) {
         start_plugin(collector, meta);
     } else {
+        Clock::set_source(meta.clock_source);
         DiagnosticPrinter diagnostics(collector, meta, cli);
         diagnostics.show();
     }
@@ -242,13 +359,40 @@ void Plugin::start_stream_collector(int argc, char **argv, StreamCollectorInterf
         exit(0);
     }
 
-    stream_collector->SetMaxCollectDuration(cli.GetFlagIntValue("max-collect-duration"));
+    stream_collector->SetMaxCollectDuration(cli.GetFlagDurationValue("max-collect-duration"));
     stream_collector->SetMaxMetricsBuffer(cli.GetFlagInt64Value("max-metrics-buffer"));
+    if (cli.IsParsedFlag("max-in-flight")) {
+        int64_t max_in_flight = cli.GetFlagInt64Value("max-in-flight");
+        if (max_in_flight < 0)
+            throw PluginException("Max in flight must be 0 or greater");
+        stream_collector->SetMaxInFlight(max_in_flight);
+    }
+    if (cli.IsParsedFlag("coalesce-metrics"))
+        stream_collector->SetCoalesceMetrics(true);
+    if (cli.IsParsedFlag("overflow-policy")) {
+        std::string policy = cli.GetFlagStrValue("overflow-policy");
+        if (policy == "block") {
+            stream_collector->SetOverflowPolicy(OverflowPolicy::Block);
+        } else if (policy == "drop-oldest") {
+            stream_collector->SetOverflowPolicy(OverflowPolicy::DropOldest);
+        } else if (policy == "drop-newest") {
+            stream_collector->SetOverflowPolicy(OverflowPolicy::DropNewest);
+        } else if (policy == "sample") {
+            stream_collector->SetOverflowPolicy(OverflowPolicy::Sample);
+        } else if (policy == "coalesce-latest") {
+            stream_collector->SetOverflowPolicy(OverflowPolicy::CoalesceLatest);
+        } else {
+            throw PluginException("Unknown overflow policy: " + policy);
+        }
+    }
+    if (cli.IsParsedFlag("overflow-sample-rate"))
+        stream_collector->SetOverflowSampleRate(cli.GetFlagIntValue("overflow-sample-rate"));
 
     start_plugin(stream_collector, meta);
 }
 
 static void start_plugin(Plugin::PluginInterface* plugin, const Plugin::Meta& meta) {
+    Plugin::Clock::set_source(meta.clock_source);
     auto exporter = Plugin::LibSetup::exporter_provider();
     // disable deleting the plugin instance
     auto plugin_ptr = shared_ptr<Plugin::PluginInterface>(plugin, [](void*){});
@@ -349,24 +493,7 @@ void Plugin::DiagnosticPrinter::print_collect_metrics(std::vector<Metric> metric
     std::vector<Metric> mts = collector->collect_metrics(metric_types);
     for (auto& metric : mts) {
         os  << "    Namespace: " << setw(40) << metric.ns().get_string() << setw(6) << "Type: " << setw(20) << metric.data_type() << setw(8) << " Value: ";
-        switch (metric.data_type()){
-            case Metric::Int32 : os << metric.get_int_data() << "\n";
-                break;
-            case Metric::Uint32 : os << metric.get_uint32_data() << "\n";
-                break;
-            case Metric::String : os << metric.get_string_data() << "\n";
-                break;
-            case Metric::Bool : os << metric.get_bool_data() << "\n";
-                break;
-            case Metric::Float32 : os << metric.get_float32_data() << "\n";
-                break;
-            case Metric::Float64 : os << metric.get_float64_data() << "\n";
-                break;
-            case Metric::Int64 : os << metric.get_int64_data() << "\n";
-                break;
-            case Metric::Uint64 : os << metric.get_uint64_data() << "\n";
-                break;
-        }
+        metric.visit([&](const auto& value) { os << value << "\n"; });
     }
     timer.print_elapsed("printCollectMetrics took ","\n");
 }
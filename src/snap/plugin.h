@@ -21,8 +21,10 @@ limitations under the License.
 
 #include <grpc++/grpc++.h>
 
+#include "snap/clock.h"
 #include "snap/config.h"
 #include "snap/metric.h"
+#include "snap/metric_batch.h"
 #include "snap/flags.h"
 
 #define RPC_VERSION 1
@@ -32,6 +34,7 @@ namespace Plugin {
     class ProcessorInterface;
     class PublisherInterface;
     class StreamCollectorInterface;
+    class Reactor;
     /**
     * Type is the plugin type
     */
@@ -178,6 +181,76 @@ namespace Plugin {
         */
         int stand_alone_port;
 
+        /**
+        * Enables the asynchronous gRPC server: calls are accepted on one
+        * completion queue per core and handled on a thread pool of the
+        * library, instead of one sync server thread per call.
+        * Stream collectors always use the sync server.
+        * Defaults to false.
+        */
+        bool async_server_enabled;
+
+        /**
+        * The fields below size the gRPC server. Unless stated otherwise, 0
+        * keeps gRPC's default.
+        */
+
+        /**
+        * Maximum size in bytes of a received message, -1 for unlimited.
+        * gRPC defaults to 4MB.
+        */
+        int max_receive_message_size;
+
+        /**
+        * Maximum size in bytes of a sent message, -1 for unlimited.
+        * gRPC defaults to unlimited.
+        */
+        int max_send_message_size;
+
+        /**
+        * Memory (in bytes) and threads the server may use, set on its
+        * grpc::ResourceQuota.
+        */
+        size_t resource_quota_bytes;
+        int resource_quota_max_threads;
+
+        /**
+        * Maximum number of threads polling for calls in the sync server.
+        */
+        int sync_server_max_threads;
+
+        /**
+        * Number of completion queues of the server. The async server defaults
+        * to one per core.
+        */
+        int completion_queue_count;
+
+        /**
+        * Interval between keepalive pings on idle connections, and how long
+        * to wait for their acknowledgement. A zero keepalive_time disables
+        * keepalive pings.
+        */
+        std::chrono::milliseconds keepalive_time;
+        std::chrono::milliseconds keepalive_timeout;
+
+        /**
+        * Compression of the replies carrying metrics (GetMetricTypes,
+        * CollectMetrics, Process and StreamMetrics), decided call by call:
+        * only replies (or stream messages) of at least compression_threshold
+        * bytes are compressed. A zero threshold compresses them all.
+        * Defaults to GRPC_COMPRESS_NONE and 0.
+        */
+        grpc_compression_algorithm compression_algorithm;
+        size_t compression_threshold;
+
+        /**
+        * clock_source selects the clock used for the timestamps set by the
+        * library. ClockSource::Coarse trades precision (a few milliseconds)
+        * for cheaper clock reads.
+        * Defaults to ClockSource::Precise.
+        */
+        ClockSource clock_source;
+
         /**
         * use_cli_args updates plugin meta using arguments from cli
         */
@@ -209,6 +282,17 @@ namespace Plugin {
         virtual StreamCollectorInterface* IsStreamCollector();
 
         virtual const ConfigPolicy get_config_policy() = 0;
+
+        /**
+        * start_events is called once when the plugin is exported, with the
+        * reactor of the library, for the plugin to register the sources it
+        * watches (netlink sockets, inotify or perf file descriptors,
+        * timers...) rather than run threads of its own. Their callbacks run
+        * on the reactor thread, e.g. to update what collect_metrics reports,
+        * or to send metrics while streaming. The reactor runs once it
+        * returns, along with the gRPC server.
+        */
+        virtual void start_events(Reactor& /*reactor*/) {}
     protected:
         PluginInterface() = default;
     };
@@ -261,8 +345,40 @@ namespace Plugin {
         /*
         * collect_metrics is given a list of metrics to collect.
         * It should collect and annotate each metric with the apropos context.
+        * Returned metrics are moved into the reply, not copied: the ones
+        * wrapping a requested metric are taken out of the request, so each of
+        * them should be returned at most once.
         */
         virtual std::vector<Metric> collect_metrics(std::vector<Metric> &metrics) = 0;
+
+        /*
+        * partition_key tells which partition a requested metric belongs to
+        * when parallel collection is enabled (@see SetCollectWorkers): each
+        * partition is given to its own collect_metrics call. These calls run
+        * concurrently, on the serving thread and the worker threads, so a
+        * collector enabling workers must make collect_metrics thread-safe.
+        * Defaults to the namespace without its last element, so that metrics
+        * read from the same source are collected together.
+        */
+        virtual std::string partition_key(const Metric& metric);
+
+        /**
+        * _collect_workers member getter and setter. The worker threads are
+        * started by the first collection split into partitions: setting the
+        * count afterwards has no effect on them, only switching back to zero
+        * does.
+        */
+        void SetCollectWorkers(unsigned int collectWorkers);
+        unsigned int GetCollectWorkers() const;
+
+    private:
+        /**
+        * number of worker threads collecting partitions of a request
+        * concurrently. collect_metrics must then be thread-safe.
+        * Defaults to zero what means collect_metrics is called once per
+        * request, on the thread serving it.
+        */
+        unsigned int _collect_workers = 0;
     };
 
     /**
@@ -357,6 +473,42 @@ namespace Plugin {
         class StreamCollectorImpl;
     }
 
+    /**
+    * OverflowPolicy tells what send_metrics does with a stream collector's
+    * metrics when the in-flight limit is reached (@see SetMaxInFlight).
+    * Dropped metrics are counted (@see dropped_metrics).
+    */
+    enum class OverflowPolicy {
+        /**
+        * Block waits for the writer to catch up. The default.
+        */
+        Block,
+
+        /**
+        * DropOldest queues the metrics anyway, and drops the oldest queued
+        * ones instead, as long as the limit is exceeded.
+        */
+        DropOldest,
+
+        /**
+        * DropNewest drops the metrics being sent.
+        */
+        DropNewest,
+
+        /**
+        * Sample keeps one send out of SetOverflowSampleRate (blocking for
+        * it), and drops the others.
+        */
+        Sample,
+
+        /**
+        * CoalesceLatest keeps the latest metric per namespace aside, and
+        * sends them once the writer has caught up. Overwritten metrics are
+        * counted as dropped.
+        */
+        CoalesceLatest
+    };
+
     /**
     * The interface for a stream collector plugin.
     * A Stream Collector is the source.
@@ -380,13 +532,35 @@ namespace Plugin {
         /*
         * get_metrics_in is given a list of metrics to collect.
         * The plugin should save it and send back those metrics while streaming.
+        * With several streams, it is given the metrics requested on all of
+        * them, again whenever a stream requests metrics or ends. Each stream
+        * is only sent the metrics it requested.
         */
         virtual void get_metrics_in(std::vector<Plugin::Metric> &metsIn) = 0;
 
         /*
-        * StreamMetrics allows the plugin to send/receive metrics
+        * StreamMetrics allows the plugin to send/receive metrics.
+        * It runs on a thread of the library as long as snapteld streams from
+        * the plugin, whatever the number of streams, and should return once
+        * context_cancelled tells there is none left.
+        * Plugins streaming from events (@see start_stream_events) don't need
+        * to implement it.
         */
-        virtual void stream_metrics() = 0;
+        virtual void stream_metrics();
+
+        /**
+        * start_stream_events is the push based alternative to stream_metrics:
+        * the plugin registers its sources (file descriptors, timers...) with
+        * reactor, and sends metrics from their callbacks, which all run on the
+        * reactor thread. It's called when snapteld starts streaming, and
+        * stop_stream_events once the last stream ended, for the plugin to
+        * remove its sources. Neither runs concurrently with the callbacks.
+        * Callbacks must not block: send_metrics should not wait for room
+        * (@see SetOverflowPolicy, would_block and on_writable).
+        * @return false, the default, to stream from stream_metrics instead.
+        */
+        virtual bool start_stream_events(Reactor& /*reactor*/) { return false; }
+        virtual void stop_stream_events(Reactor& /*reactor*/) {}
 
         /**
         * callback functions for the plugin to send messages (metrics or errors)
@@ -394,7 +568,8 @@ namespace Plugin {
         * Snap
         *
         * send_metrics support vector of metrics, vector of pointers to metrics,
-        * or vector of underlying rpc::Metric pointer
+        * or vector of underlying rpc::Metric pointer. Messages go to every
+        * stream, and context_cancelled is true when there is no stream left.
         */
         void send_metrics(const std::vector<Plugin::Metric>& metrics);
         void send_metrics(const std::vector<Plugin::Metric*>& metrics);
@@ -404,11 +579,12 @@ namespace Plugin {
         bool context_cancelled();
 
         /**
-        * _max_collect_duration member getter and setters
+        * _max_collect_duration member getter and setters.
+        * The int64_t overload takes a number of seconds.
         */
         void SetMaxCollectDuration(int64_t maxCollectDuration);
-        void SetMaxCollectDuration(std::chrono::seconds maxCollectDuration);
-        std::chrono::seconds GetMaxCollectDuration();
+        void SetMaxCollectDuration(std::chrono::nanoseconds maxCollectDuration);
+        std::chrono::nanoseconds GetMaxCollectDuration();
 
         /**
         * _max_metrics_buffer member getter and setters
@@ -416,14 +592,56 @@ namespace Plugin {
         void SetMaxMetricsBuffer(size_t maxMetricsBuffer);
         size_t GetMaxMetricsBuffer();
 
+        /**
+        * _max_in_flight member getter and setters
+        */
+        void SetMaxInFlight(size_t maxInFlight);
+        size_t GetMaxInFlight();
+
+        /**
+        * would_block tells whether send_metrics would block right now,
+        * because _max_in_flight batches of metrics are waiting to be written.
+        * Plugins sampling at a fixed rate can check it to skip a send rather
+        * than stall.
+        */
+        bool would_block();
+
+        /**
+        * on_writable is called, from the thread writing on the stream, when
+        * a send stops blocking after the in-flight limit was reached.
+        * It must not block.
+        */
+        virtual void on_writable() {}
+
+        /**
+        * _coalesce_metrics member getter and setter
+        */
+        void SetCoalesceMetrics(bool coalesceMetrics);
+        bool GetCoalesceMetrics();
+
+        /**
+        * _overflow_policy and _overflow_sample_rate member getters and setters
+        */
+        void SetOverflowPolicy(OverflowPolicy overflowPolicy);
+        OverflowPolicy GetOverflowPolicy();
+        void SetOverflowSampleRate(unsigned int overflowSampleRate);
+        unsigned int GetOverflowSampleRate();
+
+        /**
+        * dropped_metrics returns the number of metrics sent by the plugin
+        * and dropped by the overflow policy since the stream started.
+        */
+        uint64_t dropped_metrics();
+
     private:
         /**
-        * sets the maximum duration (always greater than 0s) between collections
-        * before metrics are sent. Defaults to 10s what means that after 10 seconds
-        * no new metrics are received, the plugin should send whatever data it has
-        * in the buffer instead of waiting longer. (e.g. 5s)
+        * sets the maximum duration between collections before metrics are
+        * sent, down to the nanosecond. Defaults to 10s what means that after
+        * 10 seconds no new metrics are received, the plugin should send
+        * whatever data it has in the buffer instead of waiting longer.
+        * 0 sends metrics immediately, whatever _max_metrics_buffer is
         */
-        std::chrono::seconds _max_collect_duration;
+        std::chrono::nanoseconds _max_collect_duration;
 
         /**
         * maximum number of metrics the plugin is buffering before sending metrics.
@@ -431,9 +649,33 @@ namespace Plugin {
         */
         size_t _max_metrics_buffer;
 
+        /**
+        * maximum number of send_metrics calls whose metrics are handed over to
+        * the library and not written on the stream yet. send_metrics blocks
+        * when it is reached. Defaults to zero what means unlimited
+        */
+        size_t _max_in_flight = 0;
+
+        /**
+        * what to do when _max_in_flight is reached, and for
+        * OverflowPolicy::Sample, one out of how many sends are kept.
+        * Default to blocking, and keeping 1 send out of 10
+        */
+        OverflowPolicy _overflow_policy = OverflowPolicy::Block;
+        unsigned int _overflow_sample_rate = 10;
+
+        /**
+        * when set, only the latest metric per namespace is buffered: a newer
+        * one overwrites it until the buffer is sent, which happens when it
+        * holds _max_metrics_buffer namespaces (if not zero) or
+        * _max_collect_duration after the last send. Suits gauges sampled
+        * faster than they are consumed. Defaults to false
+        */
+        bool _coalesce_metrics = false;
+
         /**
         * StreamCollector proxy implementation to forward messages from the plugin
-        * back to Snap. It is set automatically when the plugin starts streaming
+        * back to Snap. It is set automatically when the plugin is exported
         */
         friend Proxy::StreamCollectorImpl;
         Proxy::StreamCollectorImpl* _stream_collector_impl = nullptr;
@@ -0,0 +1,243 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/proxy/async_server.h"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <utility>
+
+#include "snap/rpc/plugin.grpc.pb.h"
+#include "snap/rpc/plugin.pb.h"
+#include "snap/proxy/collector_proxy.h"
+#include "snap/proxy/processor_proxy.h"
+#include "snap/proxy/publisher_proxy.h"
+
+using grpc::Server;
+using grpc::ServerAsyncResponseWriter;
+using grpc::ServerBuilder;
+using grpc::ServerCompletionQueue;
+using grpc::ServerContext;
+using grpc::Status;
+using grpc::StatusCode;
+
+using rpc::Empty;
+using rpc::ErrReply;
+using rpc::GetConfigPolicyReply;
+using rpc::GetMetricTypesArg;
+using rpc::KillArg;
+using rpc::MetricsArg;
+using rpc::MetricsReply;
+using rpc::PubProcArg;
+
+using Plugin::PluginException;
+using Plugin::ThreadPool;
+using Plugin::Proxy::AsyncServer;
+using Plugin::Proxy::CollectorImpl;
+using Plugin::Proxy::ProcessorImpl;
+using Plugin::Proxy::PublisherImpl;
+
+namespace {
+    /**
+    * Call is the tag of an asynchronous call on its completion queue.
+    */
+    class Call {
+    public:
+        virtual ~Call() {}
+        virtual void Proceed(bool ok) = 0;
+    };
+
+    /**
+    * Method binds a unary method of an async service to its handler in the
+    * sync proxy.
+    */
+    template<typename Request, typename Reply>
+    struct Method {
+        std::function<void(ServerContext*, Request*, ServerAsyncResponseWriter<Reply>*,
+                           ServerCompletionQueue*, void*)> request;
+        std::function<Status(ServerContext*, const Request*, Reply*)> handle;
+    };
+
+    /**
+    * UnaryCall goes through the states of one unary call: waiting for it,
+    * handling it on the executor, then finishing it.
+    */
+    template<typename Request, typename Reply>
+    class UnaryCall final : public Call {
+    public:
+        UnaryCall(std::shared_ptr<const Method<Request, Reply>> method,
+                  ServerCompletionQueue* cq, ThreadPool* executor,
+                  const std::atomic<bool>* stopping) :
+                    _method(std::move(method)),
+                    _cq(cq),
+                    _executor(executor),
+                    _stopping(stopping),
+                    _responder(&_context),
+                    _finishing(false) {
+            _method->request(&_context, &_request, &_responder, _cq, this);
+        }
+
+        void Proceed(bool ok) override {
+            if (_finishing || !ok) {
+                delete this;
+                return;
+            }
+            // Keep accepting calls to this method while this one is handled.
+            if (!_stopping->load()) {
+                new UnaryCall(_method, _cq, _executor, _stopping);
+            }
+            _finishing = true;
+            _executor->submit([this]() {
+                Status status;
+                try {
+                    status = _method->handle(&_context, &_request, &_reply);
+                } catch (std::exception& e) {
+                    status = Status(StatusCode::UNKNOWN, e.what());
+                }
+                _responder.Finish(_reply, status, this);
+            });
+        }
+
+    private:
+        std::shared_ptr<const Method<Request, Reply>> _method;
+        ServerCompletionQueue* _cq;
+        ThreadPool* _executor;
+        const std::atomic<bool>* _stopping;
+
+        ServerContext _context;
+        Request _request;
+        Reply _reply;
+        ServerAsyncResponseWriter<Reply> _responder;
+        bool _finishing;
+    };
+}  // namespace
+
+AsyncServer::AsyncServer(Plugin::Type type, grpc::Service* impl,
+                         ServerBuilder* builder,
+                         unsigned int queues, unsigned int workers) :
+                            _stopping(false),
+                            _server(nullptr) {
+    switch (type) {
+        case Plugin::Collector: {
+            auto service = new rpc::Collector::AsyncService();
+            auto collector = static_cast<CollectorImpl*>(impl);
+            _async_service.reset(service);
+            addMethod<MetricsArg, MetricsReply>(
+                service, &rpc::Collector::AsyncService::RequestCollectMetrics,
+                collector, &CollectorImpl::CollectMetrics);
+            addMethod<GetMetricTypesArg, MetricsReply>(
+                service, &rpc::Collector::AsyncService::RequestGetMetricTypes,
+                collector, &CollectorImpl::GetMetricTypes);
+            addCommonMethods(service, collector);
+            break;
+        }
+        case Plugin::Processor: {
+            auto service = new rpc::Processor::AsyncService();
+            auto processor = static_cast<ProcessorImpl*>(impl);
+            _async_service.reset(service);
+            addMethod<PubProcArg, MetricsReply>(
+                service, &rpc::Processor::AsyncService::RequestProcess,
+                processor, &ProcessorImpl::Process);
+            addCommonMethods(service, processor);
+            break;
+        }
+        case Plugin::Publisher: {
+            auto service = new rpc::Publisher::AsyncService();
+            auto publisher = static_cast<PublisherImpl*>(impl);
+            _async_service.reset(service);
+            addMethod<PubProcArg, ErrReply>(
+                service, &rpc::Publisher::AsyncService::RequestPublish,
+                publisher, &PublisherImpl::Publish);
+            addCommonMethods(service, publisher);
+            break;
+        }
+        default:
+            throw PluginException("Async server does not support this plugin type");
+    }
+
+    builder->RegisterService(_async_service.get());
+    for (unsigned int i = 0; i < std::max(queues, 1u); i++) {
+        _queues.push_back(builder->AddCompletionQueue());
+    }
+    _executor.reset(new ThreadPool(std::max(workers, 1u)));
+}
+
+AsyncServer::~AsyncServer() {
+    _stopping = true;
+    if (_server) {
+        _server->Shutdown();
+    }
+    // Calls being handled must be finished before their queue shuts down.
+    _executor.reset();
+    for (auto& cq : _queues) {
+        cq->Shutdown();
+    }
+    for (std::thread& poller : _pollers) {
+        poller.join();
+    }
+}
+
+void AsyncServer::Start(Server* server) {
+    _server = server;
+    for (auto& cq : _queues) {
+        for (auto& method : _methods) {
+            method(cq.get());
+        }
+        _pollers.emplace_back(&AsyncServer::poll, this, cq.get());
+    }
+}
+
+bool AsyncServer::Supports(Plugin::Type type) {
+    return type == Plugin::Collector ||
+           type == Plugin::Processor ||
+           type == Plugin::Publisher;
+}
+
+template<typename Request, typename Reply, typename Service,
+         typename RequestFn, typename Impl, typename HandleFn>
+void AsyncServer::addMethod(Service* service, RequestFn request, Impl* impl,
+                            HandleFn handle) {
+    auto method = std::make_shared<Method<Request, Reply>>();
+    method->request = [service, request](ServerContext* context, Request* req,
+                                         ServerAsyncResponseWriter<Reply>* responder,
+                                         ServerCompletionQueue* cq, void* tag) {
+        (service->*request)(context, req, responder, cq, cq, tag);
+    };
+    method->handle = [impl, handle](ServerContext* context, const Request* req,
+                                    Reply* resp) {
+        return (impl->*handle)(context, req, resp);
+    };
+    std::shared_ptr<const Method<Request, Reply>> bound = method;
+    _methods.push_back([this, bound](ServerCompletionQueue* cq) {
+        new UnaryCall<Request, Reply>(bound, cq, _executor.get(), &_stopping);
+    });
+}
+
+template<typename Service, typename Impl>
+void AsyncServer::addCommonMethods(Service* service, Impl* impl) {
+    addMethod<Empty, ErrReply>(
+        service, &Service::RequestPing, impl, &Impl::Ping);
+    addMethod<KillArg, ErrReply>(
+        service, &Service::RequestKill, impl, &Impl::Kill);
+    addMethod<Empty, GetConfigPolicyReply>(
+        service, &Service::RequestGetConfigPolicy, impl, &Impl::GetConfigPolicy);
+}
+
+void AsyncServer::poll(ServerCompletionQueue* cq) {
+    void* tag;
+    bool ok;
+    while (cq->Next(&tag, &ok)) {
+        static_cast<Call*>(tag)->Proceed(ok);
+    }
+}
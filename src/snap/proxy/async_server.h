@@ -0,0 +1,91 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <grpc++/grpc++.h>
+
+#include "snap/plugin.h"
+#include "snap/thread_pool.h"
+
+namespace Plugin {
+    namespace Proxy {
+        /**
+        * AsyncServer serves a plugin through the asynchronous gRPC API: calls
+        * are accepted on completion queues, each polled by its own thread,
+        * and handled by the plugin's proxy (e.g. CollectorImpl) on a thread
+        * pool managed by the library, instead of pinning a sync server thread
+        * per call.
+        *
+        * It supports collectors, processors and publishers. Stream collectors
+        * keep the sync server, their streams being long-lived anyway.
+        */
+        class AsyncServer final {
+        public:
+            /**
+            * AsyncServer registers the async service of the plugin type and
+            * its completion queues on builder, which must then be built and
+            * started before calling Start.
+            * @param impl the sync proxy handling the calls, e.g. CollectorImpl
+            * for Plugin::Collector. It must outlive the server.
+            * @param queues the number of completion queues (and polling threads)
+            * @param workers the number of threads handling the calls
+            * @throws PluginException when the plugin type is not supported.
+            */
+            AsyncServer(Plugin::Type type, grpc::Service* impl,
+                        grpc::ServerBuilder* builder,
+                        unsigned int queues, unsigned int workers);
+
+            /**
+            * Shuts the server down, letting calls in progress finish.
+            */
+            ~AsyncServer();
+
+            AsyncServer(const AsyncServer&) = delete;
+            AsyncServer& operator=(const AsyncServer&) = delete;
+
+            /**
+            * Start starts accepting calls on server, built from the builder
+            * given to the constructor.
+            */
+            void Start(grpc::Server* server);
+
+            static bool Supports(Plugin::Type type);
+
+        private:
+            template<typename Request, typename Reply, typename Service,
+                     typename RequestFn, typename Impl, typename HandleFn>
+            void addMethod(Service* service, RequestFn request, Impl* impl,
+                           HandleFn handle);
+
+            template<typename Service, typename Impl>
+            void addCommonMethods(Service* service, Impl* impl);
+
+            void poll(grpc::ServerCompletionQueue* cq);
+
+            std::unique_ptr<grpc::Service> _async_service;
+            std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> _queues;
+            std::vector<std::function<void(grpc::ServerCompletionQueue*)>> _methods;
+            std::unique_ptr<ThreadPool> _executor;
+            std::vector<std::thread> _pollers;
+            std::atomic<bool> _stopping;
+            grpc::Server* _server;
+        };
+    }  // namespace Proxy
+}  // namespace Plugin
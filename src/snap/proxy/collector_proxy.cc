@@ -12,12 +12,22 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 #include <grpc++/grpc++.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "snap/rpc/plugin.pb.h"
 #include "snap/proxy/collector_proxy.h"
+#include "snap/clock.h"
 #include "snap/metric.h"
 
+using std::chrono::system_clock;
+
 using google::protobuf::RepeatedPtrField;
 
 using grpc::Server;
@@ -33,7 +43,9 @@ using rpc::KillArg;
 using rpc::MetricsArg;
 using rpc::MetricsReply;
 
+using Plugin::Clock;
 using Plugin::Metric;
+using Plugin::ThreadPool;
 using Plugin::Proxy::CollectorImpl;
 
 CollectorImpl::CollectorImpl(Plugin::CollectorInterface* plugin) :
@@ -48,19 +60,31 @@ CollectorImpl::~CollectorImpl() {
 Status CollectorImpl::CollectMetrics(ServerContext* context,
                                     const MetricsArg* req,
                                     MetricsReply* resp) {
+    // The request is owned by the call and never read again once we return,
+    // so its metrics are borrowed in place rather than copied.
+    RepeatedPtrField<rpc::Metric>* rpc_mets = const_cast<MetricsArg*>(req)->mutable_metrics();
     std::vector<Metric> metrics;
-    RepeatedPtrField<rpc::Metric> rpc_mets = req->metrics();
+    metrics.reserve(rpc_mets->size());
 
-    for (int i = 0; i < rpc_mets.size(); i++) {
-        metrics.emplace_back(rpc_mets.Mutable(i));
+    for (int i = 0; i < rpc_mets->size(); i++) {
+        metrics.emplace_back(rpc_mets->Mutable(i));
     }
 
     try {
-        std::vector<Metric> result_metrics = collector->collect_metrics(metrics);
-
-        for (Metric met : result_metrics) {
-            *resp->add_metrics() = *met.get_rpc_metric_ptr();
+        std::vector<Metric> result_metrics = collect(metrics);
+        RepeatedPtrField<rpc::Metric>* reply_mets = resp->mutable_metrics();
+        reply_mets->Reserve(result_metrics.size());
+
+        for (Metric& met : result_metrics) {
+            // Metrics owned by the plugin are handed over to the reply, borrowed
+            // ones (still pointing into the request) are swapped out of it.
+            if (met.owns_rpc_metric_ptr()) {
+                reply_mets->AddAllocated(met.release_rpc_metric_ptr());
+            } else {
+                reply_mets->Add()->Swap(met.get_rpc_metric_ptr());
+            }
         }
+        compression.apply(context, *resp);
         return Status::OK;
     } catch (PluginException &e) {
         resp->set_error(e.what());
@@ -68,6 +92,67 @@ Status CollectorImpl::CollectMetrics(ServerContext* context,
     }
 }
 
+std::vector<Metric> CollectorImpl::collect(std::vector<Metric>& metrics) {
+    unsigned int workers = collector->GetCollectWorkers();
+    if (workers == 0 || metrics.size() < 2) {
+        return collector->collect_metrics(metrics);
+    }
+
+    std::unordered_map<std::string, size_t> partition_indexes;
+    std::vector<std::vector<Metric>> partitions;
+    for (Metric& met : metrics) {
+        auto it = partition_indexes.emplace(collector->partition_key(met),
+                                            partitions.size()).first;
+        if (it->second == partitions.size()) {
+            partitions.emplace_back();
+        }
+        partitions[it->second].push_back(std::move(met));
+    }
+    if (partitions.size() == 1) {
+        return collector->collect_metrics(partitions.front());
+    }
+
+    std::call_once(collect_pool_flag, [this, workers]() {
+        collect_pool.reset(new ThreadPool(workers));
+    });
+
+    std::vector<std::future<std::vector<Metric>>> pending;
+    pending.reserve(partitions.size() - 1);
+    for (size_t i = 1; i < partitions.size(); i++) {
+        std::vector<Metric>* partition = &partitions[i];
+        pending.push_back(collect_pool->submit([this, partition]() {
+            return collector->collect_metrics(*partition);
+        }));
+    }
+
+    // The serving thread collects the first partition meanwhile. Every
+    // partition must be done before returning, even on errors, as they
+    // live on this stack.
+    std::vector<Metric> result_metrics;
+    std::exception_ptr error;
+    try {
+        result_metrics = collector->collect_metrics(partitions.front());
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (auto& result : pending) {
+        try {
+            std::vector<Metric> partition_metrics = result.get();
+            result_metrics.reserve(result_metrics.size() + partition_metrics.size());
+            std::move(partition_metrics.begin(), partition_metrics.end(),
+                      std::back_inserter(result_metrics));
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return result_metrics;
+}
+
 Status CollectorImpl::GetMetricTypes(ServerContext* context,
                                     const GetMetricTypesArg* req,
                                     MetricsReply* resp) {
@@ -76,11 +161,20 @@ Status CollectorImpl::GetMetricTypes(ServerContext* context,
     try {
         std::vector<Metric> metrics = collector->get_metric_types(cfg);
 
-        for (Metric met : metrics) {
-            met.set_timestamp();
-            met.set_last_advertised_time();
-            *resp->add_metrics() = *met.get_rpc_metric_ptr();
+        system_clock::time_point now = Clock::now();
+        Metric::set_timestamps(metrics, now);
+        Metric::set_last_advertised_times(metrics, now);
+
+        RepeatedPtrField<rpc::Metric>* reply_mets = resp->mutable_metrics();
+        reply_mets->Reserve(metrics.size());
+        for (Metric& met : metrics) {
+            if (met.owns_rpc_metric_ptr()) {
+                reply_mets->AddAllocated(met.release_rpc_metric_ptr());
+            } else {
+                *reply_mets->Add() = *met.get_rpc_metric_ptr();
+            }
         }
+        compression.apply(context, *resp);
         return Status::OK;
     } catch (PluginException &e) {
         resp->set_error(e.what());
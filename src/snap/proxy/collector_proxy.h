@@ -13,12 +13,18 @@ limitations under the License.
 */
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include <grpc++/grpc++.h>
 
 #include "snap/rpc/plugin.grpc.pb.h"
 #include "snap/rpc/plugin.pb.h"
 
+#include "snap/proxy/compression.h"
 #include "snap/proxy/plugin_proxy.h"
+#include "snap/thread_pool.h"
 
 namespace Plugin {
     namespace Proxy {
@@ -46,9 +52,24 @@ namespace Plugin {
             grpc::Status Ping(grpc::ServerContext* context, const rpc::Empty* request,
                                 rpc::ErrReply* resp);
 
+            void SetCompression(const Compression& compression) {
+                this->compression = compression;
+            }
+
         private:
+            /**
+            * collect calls the plugin's collect_metrics, once per partition of
+            * metrics when parallel collection is enabled.
+            * @see CollectorInterface::SetCollectWorkers
+            */
+            std::vector<Metric> collect(std::vector<Metric>& metrics);
+
             Plugin::CollectorInterface* collector;
             PluginImpl* plugin_impl_ptr;
+            Compression compression;
+
+            std::unique_ptr<ThreadPool> collect_pool;
+            std::once_flag collect_pool_flag;
         };
     }  // namespace Proxy
 }  // namespace Plugin
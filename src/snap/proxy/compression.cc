@@ -0,0 +1,53 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/proxy/compression.h"
+
+using google::protobuf::Message;
+
+using grpc::ServerContext;
+using grpc::WriteOptions;
+
+using Plugin::Proxy::Compression;
+
+Compression::Compression(grpc_compression_algorithm algorithm, size_t threshold) :
+                         _algorithm(algorithm), _threshold(threshold) {}
+
+bool Compression::applies(const Message& message) const {
+    if (!enabled()) {
+        return false;
+    }
+    // Sizing the message walks all of it, so it is only done when needed.
+    // The size is cached in the message and reused when serializing it.
+    return _threshold == 0 || message.ByteSizeLong() >= _threshold;
+}
+
+void Compression::apply(ServerContext* context, const Message& reply) const {
+    if (context != nullptr && applies(reply)) {
+        context->set_compression_algorithm(_algorithm);
+    }
+}
+
+void Compression::start(ServerContext* context) const {
+    if (context != nullptr && enabled()) {
+        context->set_compression_algorithm(_algorithm);
+    }
+}
+
+WriteOptions Compression::write_options(const Message& message) const {
+    WriteOptions options;
+    if (enabled() && !applies(message)) {
+        options.set_no_compression();
+    }
+    return options;
+}
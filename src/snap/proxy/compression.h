@@ -0,0 +1,64 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <cstddef>
+
+#include <grpc++/grpc++.h>
+#include <google/protobuf/message.h>
+
+namespace Plugin {
+    namespace Proxy {
+        /**
+        * Compression decides, call by call, whether a reply is compressed on
+        * the wire: only replies of at least threshold bytes are, so that
+        * small ones do not pay for it.
+        * @see Meta::compression_algorithm, Meta::compression_threshold
+        */
+        class Compression final {
+        public:
+            Compression(grpc_compression_algorithm algorithm = GRPC_COMPRESS_NONE,
+                        size_t threshold = 0);
+
+            grpc_compression_algorithm algorithm() const { return _algorithm; }
+            size_t threshold() const { return _threshold; }
+
+            bool enabled() const { return _algorithm != GRPC_COMPRESS_NONE; }
+
+            /**
+            * applies tells whether message is big enough to be compressed.
+            */
+            bool applies(const google::protobuf::Message& message) const;
+
+            /**
+            * apply compresses the reply of a unary call when it applies.
+            * context may be null (e.g. calls made directly in tests).
+            */
+            void apply(grpc::ServerContext* context,
+                       const google::protobuf::Message& reply) const;
+
+            /**
+            * start enables compression on a stream. Its messages are then
+            * compressed or not, one by one, according to write_options.
+            */
+            void start(grpc::ServerContext* context) const;
+
+            grpc::WriteOptions write_options(const google::protobuf::Message& message) const;
+
+        private:
+            grpc_compression_algorithm _algorithm;
+            size_t _threshold;
+        };
+    }  // namespace Proxy
+}  // namespace Plugin
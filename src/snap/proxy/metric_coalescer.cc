@@ -0,0 +1,107 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/proxy/metric_coalescer.h"
+
+#include <vector>
+
+#include "snap/metric.h"
+
+using google::protobuf::RepeatedPtrField;
+
+using Plugin::NamespaceView;
+using Plugin::Proxy::MetricCoalescer;
+
+bool MetricCoalescer::add(const rpc::Metric& metric) {
+    uint64_t hash = NamespaceView(&metric.namespace_()).get_hash();
+    int index = find(metric, hash);
+    if (index >= 0) {
+        *_metrics.Mutable(index) = metric;
+        return true;
+    }
+    _index.emplace(hash, _metrics.size());
+    *_metrics.Add() = metric;
+    return false;
+}
+
+bool MetricCoalescer::add_allocated(rpc::Metric* metric) {
+    uint64_t hash = NamespaceView(&metric->namespace_()).get_hash();
+    int index = find(*metric, hash);
+    if (index >= 0) {
+        _metrics.Mutable(index)->Swap(metric);
+        delete metric;
+        return true;
+    }
+    _index.emplace(hash, _metrics.size());
+    _metrics.AddAllocated(metric);
+    return false;
+}
+
+bool MetricCoalescer::remove(const rpc::Metric& metric) {
+    uint64_t hash = NamespaceView(&metric.namespace_()).get_hash();
+    int index = find(metric, hash);
+    if (index < 0) {
+        return false;
+    }
+    unindex(hash, index);
+    int last = _metrics.size() - 1;
+    if (index != last) {
+        // Move the last metric in the hole, rather than shift the ones after
+        uint64_t last_hash = NamespaceView(&_metrics.Get(last).namespace_()).get_hash();
+        unindex(last_hash, last);
+        _index.emplace(last_hash, index);
+        _metrics.SwapElements(index, last);
+    }
+    _metrics.RemoveLast();
+    return true;
+}
+
+void MetricCoalescer::move_to(RepeatedPtrField<rpc::Metric>* metrics) {
+    if (metrics->empty()) {
+        metrics->Swap(&_metrics);
+    } else {
+        std::vector<rpc::Metric*> released(_metrics.size());
+        _metrics.ExtractSubrange(0, _metrics.size(), released.data());
+        for (rpc::Metric* metric : released) {
+            metrics->AddAllocated(metric);
+        }
+    }
+    _index.clear();
+}
+
+void MetricCoalescer::clear() {
+    _metrics.Clear();
+    _index.clear();
+}
+
+void MetricCoalescer::unindex(uint64_t hash, int index) {
+    auto range = _index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == index) {
+            _index.erase(it);
+            return;
+        }
+    }
+}
+
+int MetricCoalescer::find(const rpc::Metric& metric, uint64_t hash) const {
+    NamespaceView ns(&metric.namespace_());
+    auto range = _index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        // Different namespaces may share a hash
+        if (NamespaceView(&_metrics.Get(it->second).namespace_()) == ns) {
+            return it->second;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,76 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+#include <google/protobuf/repeated_field.h>
+
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+    namespace Proxy {
+        /**
+        * MetricCoalescer buffers metrics keeping only the latest one per
+        * namespace: a newer metric overwrites the buffered one in place, so
+        * the buffer never holds more metrics than there are series.
+        * Metrics are indexed by namespace hash (@see NamespaceView::get_hash),
+        * and kept in the order their namespace was first added, unless one
+        * was removed.
+        */
+        class MetricCoalescer final {
+        public:
+            /**
+            * add copies metric into the buffer.
+            * @return true when it replaced a buffered metric.
+            */
+            bool add(const rpc::Metric& metric);
+
+            /**
+            * add_allocated is add, taking ownership of metric.
+            */
+            bool add_allocated(rpc::Metric* metric);
+
+            /**
+            * remove drops the buffered metric with the same namespace as
+            * metric. The last buffered metric takes its place.
+            * @return true when there was one.
+            */
+            bool remove(const rpc::Metric& metric);
+
+            int size() const { return _metrics.size(); }
+            bool empty() const { return _metrics.empty(); }
+
+            /**
+            * move_to appends the buffered metrics to metrics, without copying
+            * them, and empties the buffer.
+            */
+            void move_to(google::protobuf::RepeatedPtrField<rpc::Metric>* metrics);
+
+            void clear();
+
+        private:
+            /**
+            * find returns the index of the buffered metric with the same
+            * namespace as metric, or -1.
+            */
+            int find(const rpc::Metric& metric, uint64_t hash) const;
+            void unindex(uint64_t hash, int index);
+
+            std::unordered_multimap<uint64_t, int> _index;
+            google::protobuf::RepeatedPtrField<rpc::Metric> _metrics;
+        };
+    }  // namespace Proxy
+}  // namespace Plugin
@@ -58,9 +58,10 @@ Status ProcessorImpl::Process(ServerContext* context, const PubProcArg* req,
     try {
         processor->process_metrics(metrics, config);
 
-        for (Metric met : metrics) {
+        for (const Metric& met : metrics) {
             *resp->add_metrics() = *met.get_rpc_metric_ptr();
         }
+        compression.apply(context, *resp);
         return Status::OK;
     } catch (PluginException &e) {
         resp->set_error(e.what());
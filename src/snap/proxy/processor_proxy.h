@@ -18,6 +18,7 @@ limitations under the License.
 #include "snap/rpc/plugin.grpc.pb.h"
 #include "snap/rpc/plugin.pb.h"
 
+#include "snap/proxy/compression.h"
 #include "snap/proxy/plugin_proxy.h"
 
 namespace Plugin {
@@ -42,9 +43,14 @@ namespace Plugin {
             grpc::Status Ping(grpc::ServerContext* context, const rpc::Empty* request,
                                 rpc::ErrReply* resp);
 
+            void SetCompression(const Compression& compression) {
+                this->compression = compression;
+            }
+
         private:
             Plugin::ProcessorInterface* processor;
             PluginImpl* plugin_impl_ptr;
+            Compression compression;
         };
     }   // namespace Proxy
 }   // namespace Plugin
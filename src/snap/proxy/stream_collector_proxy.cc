@@ -15,16 +15,19 @@ limitations under the License.
 #include <vector>
 #include <chrono>
 #include <iostream>
-#include <future>
 #include <list>
 #include <thread>
 #include <mutex>
-#include <condition_variable>
+#include <shared_mutex>
+#include <unordered_set>
 
 #include "snap/proxy/stream_collector_proxy.h"
 #include "snap/rpc/plugin.pb.h"
+#include "snap/clock.h"
 #include "snap/metric.h"
 
+using std::chrono::system_clock;
+
 using google::protobuf::RepeatedPtrField;
 
 using grpc::Server;
@@ -43,24 +46,33 @@ using rpc::MetricsReply;
 using rpc::CollectArg;
 using rpc::CollectReply;
 
+using Plugin::Clock;
 using Plugin::Metric;
+using Plugin::Namespace;
 using Plugin::PluginException;
+using Plugin::Proxy::SharedMetrics;
+using Plugin::Proxy::StreamSession;
 using Plugin::Proxy::StreamCollectorImpl;
 
 
 StreamCollectorImpl::StreamCollectorImpl(Plugin::StreamCollectorInterface* plugin) :
                                         _stream_collector(plugin) {
     _plugin_impl_ptr = new PluginImpl(plugin);
-    _metrics_reply = new rpc::MetricsReply();
-    _err_reply = new rpc::ErrReply();
-    _collect_reply.set_allocated_metrics_reply(_metrics_reply);
-    _collect_reply.set_allocated_error(_err_reply);
-    _copied_metrics_count = 0;
-    _max_collect_duration = plugin->GetMaxCollectDuration();
-    _max_metrics_buffer = plugin->GetMaxMetricsBuffer();
+    _closed_dropped_metrics = 0;
+    _stream_loop_running = false;
+    _sessions_added = 0;
+    _stream_events = false;
+    _reactor = nullptr;
+    _stream_collector->_stream_collector_impl = this;
 }
 
 StreamCollectorImpl::~StreamCollectorImpl() {
+    // With no session left, the plugin's stream_metrics is returning, and
+    // its event sources are removed
+    if (_stream_loop.joinable())
+        _stream_loop.join();
+    _own_reactor.reset();
+    _stream_collector->_stream_collector_impl = nullptr;
     delete _plugin_impl_ptr;
 }
 
@@ -71,11 +83,20 @@ Status StreamCollectorImpl::GetMetricTypes(ServerContext* context,
     try {
         std::vector<Metric> metrics = _stream_collector->get_metric_types(cfg);
 
-        for (Metric met : metrics) {
-            met.set_timestamp();
-            met.set_last_advertised_time();
-            *resp->add_metrics() = *met.get_rpc_metric_ptr();
+        system_clock::time_point now = Clock::now();
+        Metric::set_timestamps(metrics, now);
+        Metric::set_last_advertised_times(metrics, now);
+
+        RepeatedPtrField<rpc::Metric>* reply_mets = resp->mutable_metrics();
+        reply_mets->Reserve(metrics.size());
+        for (Metric& met : metrics) {
+            if (met.owns_rpc_metric_ptr()) {
+                reply_mets->AddAllocated(met.release_rpc_metric_ptr());
+            } else {
+                *reply_mets->Add() = *met.get_rpc_metric_ptr();
+            }
         }
+        _compression.apply(context, *resp);
         return Status::OK;
     } catch (PluginException &e) {
         resp->set_error(e.what());
@@ -109,168 +130,210 @@ Status StreamCollectorImpl::Ping(ServerContext* context, const Empty* req,
 
 Status StreamCollectorImpl::StreamMetrics(ServerContext* context,
                 ServerReaderWriter<CollectReply, CollectArg>* stream) {
-    try {
-        _current_context = context;
-        _current_stream = stream;
-        _stream_collector->_stream_collector_impl = this;
-        _max_collect_duration = _stream_collector->GetMaxCollectDuration();
-        _max_metrics_buffer = _stream_collector->GetMaxMetricsBuffer();
-
-        CollectArg collectMets;
-        do {
-            _current_stream->Read(&collectMets);
-            receiveReply(&collectMets);
-        } while (!collectMets.has_metrics_arg());
-
-        auto recvch = std::async(std::launch::async, &StreamCollectorImpl::streamRecv, this);
-        _collect_duration_start = std::chrono::steady_clock::now();
-
-        _stream_collector->stream_metrics();
-
-        _stream_collector->_stream_collector_impl = nullptr;
-        _current_context = nullptr;
-        _current_stream = nullptr;
-
-        _metrics_reply->mutable_metrics()->ExtractSubrange(_copied_metrics_count, _metrics_reply->metrics_size() - _copied_metrics_count, nullptr);
-        _metrics_reply->clear_metrics();
-        _copied_metrics_count = 0;
+    return StreamMetrics(context, static_cast<StreamSession::Stream*>(stream));
+}
 
-        return Status::OK;
-    } catch(PluginException &e) {
-        return Status(StatusCode::UNKNOWN, e.what());
+Status StreamCollectorImpl::StreamMetrics(ServerContext* context,
+                                          StreamSession::Stream* stream) {
+    StreamSession session(this, _stream_collector, context, stream, _compression);
+    // The session takes no metrics until snapteld requests some
+    addSession(&session);
+    Status status = Status::OK;
+    try {
+        if (session.receiveRequest()) {
+            session.startWriterThread();
+            startStreamLoop();
+            session.receive();
+        }
+    } catch (PluginException &e) {
+        status = Status(StatusCode::UNKNOWN, e.what());
     }
+    // Producers blocked on the session return before it is removed, then
+    // the writer sends what is left.
+    session.close();
+    try {
+        if (removeSession(&session)) {
+            metricsRequested();
+        } else {
+            stopStreamEvents();
+        }
+    } catch (PluginException &e) {
+        std::cout << "Error: " << e.what() << std::endl;
+    }
+    session.stopWriterThread();
+    return status;
 }
 
+void StreamCollectorImpl::addSession(StreamSession* session) {
+    std::unique_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    _sessions.push_back(session);
+}
 
-template<>
-rpc::Metric* StreamCollectorImpl::get_rpc_metric(const Plugin::Metric& met) const {
-    return met.get_rpc_metric_ptr();
+bool StreamCollectorImpl::removeSession(StreamSession* session) {
+    std::unique_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    _sessions.remove(session);
+    _closed_dropped_metrics += session->droppedMetrics();
+    return !_sessions.empty();
 }
 
-template<>
-rpc::Metric* StreamCollectorImpl::get_rpc_metric(Plugin::Metric* const& met) const {
-    return met->get_rpc_metric_ptr();
+void StreamCollectorImpl::startStreamLoop() {
+    std::lock_guard<std::mutex> lock(_stream_loop_mutex);
+    _sessions_added++;
+    if (_stream_loop_running || _stream_events)
+        return;
+    if (startStreamEvents())
+        return;
+    if (_stream_loop.joinable())
+        _stream_loop.join();
+    _stream_loop_running = true;
+    _stream_loop = std::thread(&StreamCollectorImpl::runStreamLoop, this);
 }
 
-template<>
-rpc::Metric* StreamCollectorImpl::get_rpc_metric(rpc::Metric* const& met) const {
-    return met;
+bool StreamCollectorImpl::startStreamEvents() {
+    // A reactor of our own only runs once the plugin registered its
+    // sources: until then, call runs on this thread.
+    if (!_reactor) {
+        _own_reactor.reset(new Reactor());
+        _reactor = _own_reactor.get();
+    }
+    bool started = false;
+    _reactor->call([this, &started]() {
+        started = _stream_collector->start_stream_events(*_reactor);
+    });
+    if (started) {
+        _stream_events = true;
+        _reactor->start();
+    }
+    return started;
 }
 
-template<typename T>
-void StreamCollectorImpl::sendMetrics(const std::vector<T>& metrics) {
-    // Metrics are sent synchronously, so we try ot to copy them as little sa possible
-    if (!_current_context->IsCancelled()) {
-        // If _max_metrics_buffer == 0 we send all metrics we have directly
-        if (_max_metrics_buffer == 0) {
-            for (const T& met : metrics)
-                _metrics_reply->mutable_metrics()->AddAllocated(get_rpc_metric(met));
-            sendAndClearMetricsReply();
+void StreamCollectorImpl::stopStreamEvents() {
+    std::lock_guard<std::mutex> lock(_stream_loop_mutex);
+    // A session may have come in since the last one was removed
+    if (!_stream_events || !contextCancelled())
+        return;
+    _stream_events = false;
+    _reactor->call([this]() {
+        _stream_collector->stop_stream_events(*_reactor);
+    });
+}
+
+void StreamCollectorImpl::runStreamLoop() {
+    while (true) {
+        uint64_t sessions_added;
+        {
+            std::lock_guard<std::mutex> lock(_stream_loop_mutex);
+            sessions_added = _sessions_added;
         }
-        // Otherwise we first send as much as possible chunks of #_max_metrics_buffer metrics
-        else {
-            size_t index = 0;
-            size_t chunk_count = (_metrics_reply->metrics_size() + metrics.size()) / _max_metrics_buffer;
-            for (size_t i = 0; i < chunk_count; i++) {
-                while (_metrics_reply->metrics_size() < _max_metrics_buffer) {
-                    _metrics_reply->mutable_metrics()->AddAllocated(get_rpc_metric(metrics[index]));
-                    index++;
-                }
-                sendAndClearMetricsReply();
-            }
+        try {
+            _stream_collector->stream_metrics();
+        } catch (PluginException &e) {
+            sendErrorMessage(e.what());
+            std::lock_guard<std::mutex> lock(_stream_loop_mutex);
+            _stream_loop_running = false;
+            return;
+        }
+        // stream_metrics returns once there is no session left, but one may
+        // have come in meanwhile. A plugin returning on its own is not
+        // restarted for the sessions it already served.
+        std::lock_guard<std::mutex> lock(_stream_loop_mutex);
+        if (_sessions_added == sessions_added || contextCancelled()) {
+            _stream_loop_running = false;
+            return;
+        }
+    }
+}
 
-            // If _max_collect_duration timer has expired we send the remaining metrics directly
-            if (std::chrono::steady_clock::now() - _collect_duration_start >= _max_collect_duration) {
-                while (index < metrics.size()) {
-                    _metrics_reply->mutable_metrics()->AddAllocated(get_rpc_metric(metrics[index]));
-                    index++;
-                }
-                sendAndClearMetricsReply();
-            }
-            // Otherwise we copy (and take ownership of) the remaning metrics to be sent later
-            else {
-                while (index < metrics.size()) {
-                    *_metrics_reply->add_metrics() = *get_rpc_metric(metrics[index]);
-                    _copied_metrics_count++;
-                    index++;
-                }
+void StreamCollectorImpl::metricsRequested() {
+    // The plugin is given all the metrics requested on the open sessions
+    std::lock_guard<std::mutex> lock(_metrics_requested_mutex);
+    std::vector<Metric> metrics;
+    std::unordered_set<Namespace> namespaces;
+    {
+        std::shared_lock<std::shared_timed_mutex> sessions_lock(_sessions_mutex);
+        for (const StreamSession* session : _sessions) {
+            for (Metric& met : session->requested()) {
+                if (namespaces.insert(met.ns()).second)
+                    metrics.push_back(std::move(met));
             }
         }
     }
+    _stream_collector->get_metrics_in(metrics);
+}
+
+template<typename T>
+void StreamCollectorImpl::sendMetrics(const std::vector<T>& metrics) {
+    // Each metric is copied once, whatever the number of sessions taking it
+    SharedMetrics<T> shared(metrics);
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    for (StreamSession* session : _sessions)
+        session->sendMetrics(shared);
 }
 
 template void StreamCollectorImpl::sendMetrics(const std::vector<Plugin::Metric>& metrics);
 template void StreamCollectorImpl::sendMetrics(const std::vector<Plugin::Metric*>& metrics);
 template void StreamCollectorImpl::sendMetrics(const std::vector<rpc::Metric*>& metrics);
 
-
 void StreamCollectorImpl::sendErrorMessage(const std::string& msg) {
-    try {
-        if (!_current_context->IsCancelled()) {
-            _err_reply->set_error(msg);
-            _current_stream->Write(_collect_reply);
-        }
-    } catch (PluginException &e) {
-        std::cout << "Error" << std::endl;
-    }
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    for (StreamSession* session : _sessions)
+        session->sendErrorMessage(msg);
 }
 
 bool StreamCollectorImpl::contextCancelled() {
-    return _current_context->IsCancelled();
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    return _sessions.empty();
 }
 
-
-bool StreamCollectorImpl::sendAndClearMetricsReply() {
-    if (_metrics_reply->metrics_size() == 0)
-        return true;
-    bool success = false;
-    try {
-        success = _current_stream->Write(_collect_reply);
-    } catch (PluginException &e) {
-        success = false;
-        std::cout << "Error" << std::endl;
+bool StreamCollectorImpl::wouldBlock() const {
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    for (const StreamSession* session : _sessions) {
+        if (session->wouldBlock())
+            return true;
     }
-    // Clear _metrics_reply:
-    // metrics which were copied (at the beginning of the array) are released,
-    // metrics which were not copied are simply extracted (they are owned by the plugin)
-    _metrics_reply->mutable_metrics()->ExtractSubrange(_copied_metrics_count, _metrics_reply->metrics_size() - _copied_metrics_count, nullptr);
-    _metrics_reply->clear_metrics();
-    _copied_metrics_count = 0;
-    _collect_duration_start = std::chrono::steady_clock::now();
-    return success;
+    return false;
 }
 
-void StreamCollectorImpl::receiveReply(const rpc::CollectArg* reply) {
-    if (reply->maxcollectduration() > 0) {
-        _max_collect_duration = std::chrono::seconds(reply->maxcollectduration());
-        _stream_collector->SetMaxCollectDuration(_max_collect_duration);
-    }
-    if (reply->maxmetricsbuffer() > 0) {
-        _max_metrics_buffer = reply->maxmetricsbuffer();
-        _stream_collector->SetMaxMetricsBuffer(_max_metrics_buffer);
-    }
+uint64_t StreamCollectorImpl::droppedMetrics() const {
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    uint64_t dropped = _closed_dropped_metrics.load();
+    for (const StreamSession* session : _sessions)
+        dropped += session->droppedMetrics();
+    return dropped;
+}
 
-    if (reply->has_metrics_arg()) {
-        std::vector<Metric> recv_mets;
-        RepeatedPtrField<rpc::Metric> rpc_mets = reply->metrics_arg().metrics();
+void StreamCollectorImpl::SetMaxCollectDuration(std::chrono::nanoseconds maxCollectDuration) {
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    for (StreamSession* session : _sessions)
+        session->SetMaxCollectDuration(maxCollectDuration);
+}
 
-        for (int i = 0; i < rpc_mets.size(); i++) {
-            recv_mets.emplace_back(rpc_mets.Mutable(i));
-        }
-        _stream_collector->get_metrics_in(recv_mets);
-    }
+void StreamCollectorImpl::SetMaxMetricsBuffer(size_t maxMetricsBuffer) {
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    for (StreamSession* session : _sessions)
+        session->SetMaxMetricsBuffer(maxMetricsBuffer);
 }
 
-bool StreamCollectorImpl::streamRecv() {
-    try {
-        while (!_current_context->IsCancelled()) {
-            CollectArg collectMets;
-            _current_stream->Read(&collectMets);
-            receiveReply(&collectMets);
-       }
-        return true;
-    } catch (PluginException &e) {
-        std::cout << "Error" << std::endl;
-        return false;
-    }
+void StreamCollectorImpl::SetMaxInFlight(size_t maxInFlight) {
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    for (StreamSession* session : _sessions)
+        session->SetMaxInFlight(maxInFlight);
+}
+
+void StreamCollectorImpl::SetCoalesceMetrics(bool coalesceMetrics) {
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    for (StreamSession* session : _sessions)
+        session->SetCoalesceMetrics(coalesceMetrics);
+}
+
+void StreamCollectorImpl::SetOverflowPolicy(Plugin::OverflowPolicy overflowPolicy) {
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    for (StreamSession* session : _sessions)
+        session->SetOverflowPolicy(overflowPolicy);
+}
+
+void StreamCollectorImpl::SetOverflowSampleRate(unsigned int overflowSampleRate) {
+    std::shared_lock<std::shared_timed_mutex> lock(_sessions_mutex);
+    for (StreamSession* session : _sessions)
+        session->SetOverflowSampleRate(overflowSampleRate);
 }
@@ -14,20 +14,33 @@ limitations under the License.
 #pragma once
 
 #include <grpc++/grpc++.h>
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <vector>
 #include <list>
 #include <thread>
 #include <mutex>
-#include <condition_variable>
+#include <shared_mutex>
 
 #include "snap/rpc/plugin.grpc.pb.h"
 #include "snap/rpc/plugin.pb.h"
 
+#include "snap/reactor.h"
+
+#include "snap/proxy/compression.h"
 #include "snap/proxy/plugin_proxy.h"
+#include "snap/proxy/stream_session.h"
 
 namespace Plugin {
     namespace Proxy {
+        /**
+        * StreamCollectorImpl serves any number of StreamMetrics calls at once,
+        * each one a StreamSession. The plugin streams to all of them: while
+        * there is a session, either its stream_metrics runs on a thread of
+        * the library, or its event sources are registered with a reactor
+        * (@see StreamCollectorInterface::start_stream_events).
+        */
         class StreamCollectorImpl final : public rpc::StreamCollector::Service {
         public:
             explicit StreamCollectorImpl(Plugin::StreamCollectorInterface* plugin);
@@ -53,51 +66,104 @@ namespace Plugin {
             grpc::Status StreamMetrics(grpc::ServerContext* context,
                             grpc::ServerReaderWriter<rpc::CollectReply, rpc::CollectArg>* stream);
 
-            void SetMaxCollectDuration(std::chrono::seconds maxCollectDuration) {
-                _max_collect_duration = maxCollectDuration;
-            }
-            std::chrono::seconds GetMaxCollectDuration () const {
-                return _max_collect_duration;
-            }
-            void SetMaxMetricsBuffer(size_t maxMetricsBuffer) {
-                _max_metrics_buffer = maxMetricsBuffer;
+            /**
+            * StreamMetrics serves stream until snapteld closes it or the call
+            * is cancelled.
+            */
+            grpc::Status StreamMetrics(grpc::ServerContext* context,
+                                       StreamSession::Stream* stream);
+
+            /**
+            * The setters apply to every session, and the ones started after.
+            */
+            void SetMaxCollectDuration(std::chrono::nanoseconds maxCollectDuration);
+            void SetMaxMetricsBuffer(size_t maxMetricsBuffer);
+            void SetMaxInFlight(size_t maxInFlight);
+            void SetCoalesceMetrics(bool coalesceMetrics);
+            void SetOverflowPolicy(Plugin::OverflowPolicy overflowPolicy);
+            void SetOverflowSampleRate(unsigned int overflowSampleRate);
+            void SetCompression(const Compression& compression) {
+                _compression = compression;
             }
-            size_t GetMaxMetricsBuffer() const {
-                return _max_metrics_buffer;
+            /**
+            * SetReactor sets the reactor the plugin streams from events on
+            * (@see StreamCollectorInterface::start_stream_events). Without
+            * one, the proxy starts its own when needed.
+            */
+            void SetReactor(Reactor* reactor) {
+                _reactor = reactor;
             }
 
-            bool sendAndClearMetricsReply();
-            void receiveReply(const rpc::CollectArg* reply);
-            bool streamRecv();
+            /**
+            * droppedMetrics sums the metrics dropped by all the sessions,
+            * closed ones included.
+            */
+            uint64_t droppedMetrics() const;
 
             /**
-             * sendMetrics (and get_rpc_metric below) have three specializations
-             * as defined by caller functions in plugin.h: T = vector<Plugin::Metric>,
-             * T = vector<Plugin::Metric*> and T = vector<rpc::Metric*>
-             */
+            * sendMetrics sends to the sessions subscribed to the metrics, and
+            * sendErrorMessage to every session.
+            * @see StreamSession::sendMetrics
+            */
             template<typename T>
             void sendMetrics(const std::vector<T>& metrics);
             void sendErrorMessage(const std::string& msg);
+
+            /**
+            * contextCancelled tells whether there is no session left to
+            * send to: the plugin's stream_metrics should return.
+            */
             bool contextCancelled();
 
+            /**
+            * wouldBlock tells whether a send would block on any session.
+            */
+            bool wouldBlock() const;
+
+            /**
+            * metricsRequested hands the metrics requested on all the sessions
+            * over to the plugin (@see get_metrics_in), whenever a session
+            * requests metrics or ends.
+            */
+            void metricsRequested();
 
         private:
             Plugin::StreamCollectorInterface* _stream_collector;
             PluginImpl* _plugin_impl_ptr;
-            grpc::ServerContext* _ctx;
-            size_t _max_metrics_buffer;
-            std::chrono::seconds _max_collect_duration;
-            rpc::CollectReply _collect_reply;
-            rpc::MetricsReply *_metrics_reply;
-            rpc::ErrReply *_err_reply;
-            size_t _copied_metrics_count;
-            std::chrono::steady_clock::time_point _collect_duration_start;
-
-            grpc::ServerContext* _current_context;
-            grpc::ServerReaderWriter<rpc::CollectReply, rpc::CollectArg>* _current_stream;
-
-            template<typename T>
-            rpc::Metric* get_rpc_metric(const T& met) const;
+            Compression _compression;
+
+            // Sends hold _sessions_mutex shared, while sessions are added
+            // and removed holding it exclusively.
+            mutable std::shared_timed_mutex _sessions_mutex;
+            std::list<StreamSession*> _sessions;
+            std::atomic<uint64_t> _closed_dropped_metrics;
+
+            std::mutex _metrics_requested_mutex;
+
+            // _stream_loop runs the plugin's stream_metrics. _stream_loop_mutex
+            // guards _stream_loop_running and _sessions_added, which tells
+            // whether a session came in while stream_metrics was returning,
+            // and _stream_events, set while the plugin streams from events.
+            std::mutex _stream_loop_mutex;
+            std::thread _stream_loop;
+            bool _stream_loop_running;
+            uint64_t _sessions_added;
+            bool _stream_events;
+
+            // The reactor of the library, or one of the proxy's own, only
+            // started for plugins streaming from events
+            Reactor* _reactor;
+            std::unique_ptr<Reactor> _own_reactor;
+
+            void addSession(StreamSession* session);
+            /**
+            * @return whether sessions are left.
+            */
+            bool removeSession(StreamSession* session);
+            void startStreamLoop();
+            void runStreamLoop();
+            bool startStreamEvents();
+            void stopStreamEvents();
         };
     }  // namespace Proxy
 }  // namespace Plugin
@@ -0,0 +1,492 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <grpc++/grpc++.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include "snap/proxy/stream_session.h"
+#include "snap/proxy/stream_collector_proxy.h"
+#include "snap/rpc/plugin.pb.h"
+#include "snap/metric.h"
+
+using google::protobuf::RepeatedPtrField;
+
+using grpc::ServerContext;
+
+using rpc::CollectArg;
+using rpc::CollectReply;
+
+using Plugin::Metric;
+using Plugin::NamespaceIndex;
+using Plugin::NamespaceView;
+using Plugin::PluginException;
+using Plugin::Proxy::SharedMetrics;
+using Plugin::Proxy::StreamSession;
+
+
+StreamSession::StreamSession(StreamCollectorImpl* owner,
+                             Plugin::StreamCollectorInterface* plugin,
+                             ServerContext* context, Stream* stream,
+                             const Compression& compression) :
+                            _owner(owner), _plugin(plugin), _context(context),
+                            _stream(stream), _compression(compression) {
+    _metrics_reply = new rpc::MetricsReply();
+    _err_reply = new rpc::ErrReply();
+    _collect_reply.set_allocated_metrics_reply(_metrics_reply);
+    _collect_reply.set_allocated_error(_err_reply);
+    _writer_idle = false;
+    _writer_stopping = false;
+    _closed = false;
+    _subscribed = false;
+    _in_flight = 0;
+    _dropped_metrics = 0;
+    _overflow_sends = 0;
+    _coalesced_pending = false;
+    _coalesce_metrics = plugin->GetCoalesceMetrics();
+    _max_collect_duration = plugin->GetMaxCollectDuration();
+    _max_metrics_buffer = plugin->GetMaxMetricsBuffer();
+    _max_in_flight = plugin->GetMaxInFlight();
+    _overflow_policy = plugin->GetOverflowPolicy();
+    _overflow_sample_rate = plugin->GetOverflowSampleRate();
+    _compression.start(context);
+}
+
+StreamSession::~StreamSession() {
+    stopWriterThread();
+    clearMetricsReply();
+}
+
+bool StreamSession::receiveRequest() {
+    CollectArg arg;
+    do {
+        if (!_stream->Read(&arg))
+            return false;
+        receiveReply(arg);
+    } while (!arg.has_metrics_arg());
+    return true;
+}
+
+void StreamSession::receive() {
+    // Read returns false once snapteld closed its side of the stream, or the
+    // call is cancelled: either way nothing more is coming.
+    CollectArg arg;
+    while (_stream->Read(&arg)) {
+        receiveReply(arg);
+        arg.Clear();
+    }
+}
+
+void StreamSession::receiveReply(const CollectArg& arg) {
+    // Limits requested by snapteld only apply to this session
+    if (arg.maxcollectduration() > 0) {
+        SetMaxCollectDuration(std::chrono::nanoseconds(arg.maxcollectduration()));
+    }
+    if (arg.maxmetricsbuffer() > 0) {
+        SetMaxMetricsBuffer(arg.maxmetricsbuffer());
+    }
+
+    if (arg.has_metrics_arg()) {
+        std::vector<Metric> requested;
+        NamespaceIndex<bool> subscription;
+        requested.reserve(arg.metrics_arg().metrics_size());
+        for (const rpc::Metric& met : arg.metrics_arg().metrics()) {
+            // The request is cleared once read: the metrics are copied
+            const Metric view(const_cast<rpc::Metric*>(&met));
+            requested.push_back(view);
+            subscription.add(view.ns(), true);
+        }
+        {
+            std::unique_lock<std::shared_timed_mutex> lock(_subscription_mutex);
+            _requested = std::move(requested);
+            _subscription = std::move(subscription);
+            _subscribed = true;
+        }
+        _owner->metricsRequested();
+    }
+}
+
+std::vector<Metric> StreamSession::requested() const {
+    std::shared_lock<std::shared_timed_mutex> lock(_subscription_mutex);
+    return _requested;
+}
+
+bool StreamSession::cancelled() const {
+    return _closed.load() || _context->IsCancelled();
+}
+
+void StreamSession::close() {
+    {
+        std::lock_guard<std::mutex> lock(_in_flight_mutex);
+        _closed = true;
+    }
+    // Let producers waiting for room on this stream return
+    _in_flight_cond.notify_all();
+}
+
+void StreamSession::startWriterThread() {
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+    if (_writer_thread.joinable())
+        return;
+    _collect_duration_start = std::chrono::steady_clock::now();
+    _writer_stopping = false;
+    _writer_thread = std::thread(&StreamSession::writeMetrics, this);
+}
+
+void StreamSession::stopWriterThread() {
+    if (!_writer_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        _writer_stopping = true;
+    }
+    _writer_cond.notify_one();
+    _writer_thread.join();
+    // Let producers blocked on a stream that ended return
+    _in_flight_cond.notify_all();
+}
+
+
+template<typename T>
+bool StreamSession::select(const SharedMetrics<T>& metrics,
+                           std::vector<size_t>& selected) const {
+    std::shared_lock<std::shared_timed_mutex> lock(_subscription_mutex);
+    if (!_subscribed)
+        return false;
+    selected.reserve(metrics.size());
+    for (size_t i = 0; i < metrics.size(); i++) {
+        if (_subscription.size() == 0 ||
+                _subscription.find(NamespaceView(&metrics.get(i).namespace_())) != nullptr)
+            selected.push_back(i);
+    }
+    return !selected.empty();
+}
+
+template<typename T>
+void StreamSession::coalesce(const SharedMetrics<T>& metrics,
+                             const std::vector<size_t>& selected, bool overflow) {
+    // Newer metrics are copied over the buffered ones, reusing their memory
+    bool flush;
+    {
+        std::lock_guard<std::mutex> lock(_coalesce_mutex);
+        for (size_t index : selected) {
+            if (_coalescer.add(metrics.get(index)) && overflow)
+                _dropped_metrics++;
+        }
+        size_t max_metrics_buffer = _max_metrics_buffer.load();
+        flush = overflow || _max_collect_duration.load().count() == 0 ||
+                (max_metrics_buffer != 0 && static_cast<size_t>(_coalescer.size()) >= max_metrics_buffer);
+    }
+    if (flush) {
+        _coalesced_pending = true;
+        wakeWriter();
+    }
+}
+
+template<typename T>
+void StreamSession::sendMetrics(SharedMetrics<T>& metrics) {
+    if (cancelled())
+        return;
+    std::vector<size_t> selected;
+    if (!select(metrics, selected))
+        return;
+    if (_coalesce_metrics.load()) {
+        coalesce(metrics, selected, false);
+        return;
+    }
+    // Waiting for room before copying bounds the memory held by the queue
+    switch (admit(selected.size())) {
+        case Admission::Drop:
+            return;
+        case Admission::Coalesce:
+            coalesce(metrics, selected, true);
+            return;
+        case Admission::Queue:
+            break;
+    }
+    // The caller keeps its metrics, and the writer sends them later, so they
+    // are copied once for all the sessions, then only borrowed.
+    QueuedSend send;
+    send.metrics.reserve(selected.size());
+    for (size_t index : selected)
+        send.metrics.push_back(metrics.copy(index));
+    send.copies = metrics.copies();
+    enqueue(std::move(send));
+}
+
+template void StreamSession::sendMetrics(SharedMetrics<Plugin::Metric>& metrics);
+template void StreamSession::sendMetrics(SharedMetrics<Plugin::Metric*>& metrics);
+template void StreamSession::sendMetrics(SharedMetrics<rpc::Metric*>& metrics);
+
+
+void StreamSession::sendErrorMessage(const std::string& msg) {
+    if (cancelled())
+        return;
+    // Errors are never dropped nor held back
+    _in_flight++;
+    QueuedSend send;
+    send.error = msg;
+    enqueue(std::move(send));
+}
+
+bool StreamSession::wouldBlock() const {
+    size_t max_in_flight = _max_in_flight.load();
+    return max_in_flight != 0 && _in_flight.load() >= max_in_flight;
+}
+
+StreamSession::Admission StreamSession::admit(size_t count) {
+    if (wouldBlock()) {
+        switch (_overflow_policy.load()) {
+            case Plugin::OverflowPolicy::Block:
+                break;
+            case Plugin::OverflowPolicy::DropOldest:
+                // The writer drops the oldest queued sends while over the limit
+                _in_flight++;
+                return Admission::Queue;
+            case Plugin::OverflowPolicy::DropNewest:
+                _dropped_metrics += count;
+                return Admission::Drop;
+            case Plugin::OverflowPolicy::Sample:
+                if (++_overflow_sends % _overflow_sample_rate.load() != 0) {
+                    _dropped_metrics += count;
+                    return Admission::Drop;
+                }
+                break;
+            case Plugin::OverflowPolicy::CoalesceLatest:
+                return Admission::Coalesce;
+        }
+    }
+    if (!acquireInFlight())
+        return Admission::Drop;
+    return Admission::Queue;
+}
+
+bool StreamSession::acquireInFlight() {
+    if (_max_in_flight.load() == 0) {
+        _in_flight++;
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(_in_flight_mutex);
+    _in_flight_cond.wait(lock, [this]() {
+        return !wouldBlock() || cancelled();
+    });
+    if (cancelled())
+        return false;
+    _in_flight++;
+    return true;
+}
+
+void StreamSession::releaseInFlight() {
+    // Called by the writer once it is done with a queued reply
+    if (_max_in_flight.load() == 0) {
+        _in_flight--;
+        return;
+    }
+    bool was_blocking;
+    {
+        std::lock_guard<std::mutex> lock(_in_flight_mutex);
+        was_blocking = wouldBlock();
+        _in_flight--;
+    }
+    if (was_blocking && !wouldBlock()) {
+        _in_flight_cond.notify_all();
+        _plugin->on_writable();
+    }
+}
+
+void StreamSession::SetMaxInFlight(size_t maxInFlight) {
+    {
+        std::lock_guard<std::mutex> lock(_in_flight_mutex);
+        _max_in_flight = maxInFlight;
+    }
+    _in_flight_cond.notify_all();
+}
+
+void StreamSession::enqueue(QueuedSend send) {
+    if (_overflow_policy.load() == Plugin::OverflowPolicy::CoalesceLatest &&
+            !send.metrics.empty()) {
+        // The writer takes the coalesced metrics after the queued sends: the
+        // ones this send supersedes must not be written after it.
+        std::lock_guard<std::mutex> lock(_coalesce_mutex);
+        if (!_coalescer.empty()) {
+            for (const rpc::Metric* met : send.metrics) {
+                if (_coalescer.remove(*met))
+                    _dropped_metrics++;
+            }
+        }
+        _send_queue.push(std::move(send));
+    } else {
+        _send_queue.push(std::move(send));
+    }
+    wakeWriter();
+}
+
+void StreamSession::wakeWriter() {
+    // The writer sets _writer_idle before checking the queue a last time and
+    // going to sleep, so either it sees the new reply, or we see it idle.
+    if (_writer_idle.load()) {
+        std::lock_guard<std::mutex> lock(_writer_mutex);
+        _writer_cond.notify_one();
+    }
+}
+
+
+bool StreamSession::sendAndClearMetricsReply() {
+    if (_metrics_reply->metrics_size() == 0 && _err_reply->error().empty())
+        return true;
+    bool success = false;
+    try {
+        success = _stream->Write(_collect_reply,
+                                         _compression.write_options(_collect_reply));
+    } catch (PluginException &e) {
+        success = false;
+        std::cout << "Error" << std::endl;
+    }
+    clearMetricsReply();
+    _collect_duration_start = std::chrono::steady_clock::now();
+    return success;
+}
+
+void StreamSession::clearMetricsReply() {
+    // The reply doesn't own its metrics: they are released, not deleted
+    _metrics_reply->mutable_metrics()->UnsafeArenaExtractSubrange(
+        0, _metrics_reply->metrics_size(), nullptr);
+    _borrowed.clear();
+    _owned.clear();
+    _err_reply->clear_error();
+}
+
+void StreamSession::bufferMetric(rpc::Metric* metric) {
+    _metrics_reply->mutable_metrics()->UnsafeArenaAddAllocated(metric);
+    size_t max_metrics_buffer = _max_metrics_buffer.load();
+    if (max_metrics_buffer != 0 && static_cast<size_t>(_metrics_reply->metrics_size()) >= max_metrics_buffer)
+        sendAndClearMetricsReply();
+}
+
+void StreamSession::bufferSend(QueuedSend& send) {
+    // The shared copies outlive the replies the metrics are sent in
+    if (!send.metrics.empty()) {
+        _borrowed.push_back(std::move(send.copies));
+        for (rpc::Metric* met : send.metrics)
+            bufferMetric(met);
+    }
+    // Errors are sent right away, along with the metrics buffered so far
+    if (_max_metrics_buffer.load() == 0 || !send.error.empty()) {
+        _err_reply->set_error(send.error);
+        sendAndClearMetricsReply();
+    }
+}
+
+void StreamSession::takeCoalesced() {
+    RepeatedPtrField<rpc::Metric> coalesced;
+    {
+        std::lock_guard<std::mutex> lock(_coalesce_mutex);
+        _coalescer.move_to(&coalesced);
+    }
+    if (_context->IsCancelled() || coalesced.empty())
+        return;
+    std::vector<rpc::Metric*> metrics(coalesced.size());
+    coalesced.ExtractSubrange(0, coalesced.size(), metrics.data());
+    for (rpc::Metric* met : metrics) {
+        _owned.emplace_back(met);
+        bufferMetric(met);
+    }
+    if (_max_metrics_buffer.load() == 0)
+        sendAndClearMetricsReply();
+}
+
+void StreamSession::writeMetrics() {
+    std::unique_lock<std::mutex> lock(_writer_mutex);
+    while (true) {
+        std::chrono::nanoseconds max_collect_duration = _max_collect_duration.load();
+        bool stopping = _writer_stopping;
+        lock.unlock();
+
+        QueuedSend send;
+        while (_send_queue.pop(send)) {
+            if (_context->IsCancelled()) {
+                // Nothing is sent anymore
+            } else if (overLimit(send)) {
+                _dropped_metrics += send.metrics.size();
+            } else {
+                bufferSend(send);
+            }
+            send = QueuedSend();
+            releaseInFlight();
+        }
+
+        // The deadline is recomputed on every wake up: a send or a new
+        // _max_collect_duration moves it.
+        auto now = std::chrono::steady_clock::now();
+        bool flush = stopping || now >= _collect_duration_start + max_collect_duration;
+        if (_coalesced_pending.exchange(false) || (flush && _coalesce_metrics.load()))
+            takeCoalesced();
+        if (flush) {
+            if (_metrics_reply->metrics_size() > 0) {
+                if (!_context->IsCancelled()) {
+                    sendAndClearMetricsReply();
+                } else {
+                    clearMetricsReply();
+                }
+            } else if (_coalesce_metrics.load()) {
+                // Start the next window, rather than spin on an expired one
+                _collect_duration_start = now;
+            }
+        }
+        lock.lock();
+
+        if (stopping) {
+            if (_send_queue.empty() && !_coalesced_pending)
+                break;
+            continue;
+        }
+        if (_writer_stopping)
+            continue;
+
+        _writer_idle = true;
+        if (_send_queue.empty() && !_coalesced_pending) {
+            // Coalesced metrics are flushed on the deadline, unless it is 0
+            // and producers ask for it on each send.
+            max_collect_duration = _max_collect_duration.load();
+            bool timed = _metrics_reply->metrics_size() > 0 ||
+                         (_coalesce_metrics.load() && max_collect_duration.count() > 0);
+            if (!timed) {
+                _writer_cond.wait(lock);
+            } else {
+                _writer_cond.wait_until(lock, _collect_duration_start + max_collect_duration);
+            }
+        }
+        _writer_idle = false;
+    }
+}
+
+bool StreamSession::overLimit(const QueuedSend& send) const {
+    // The reply just popped is still counted in _in_flight
+    size_t max_in_flight = _max_in_flight.load();
+    return _overflow_policy.load() == Plugin::OverflowPolicy::DropOldest &&
+           max_in_flight != 0 && _in_flight.load() > max_in_flight &&
+           send.error.empty();
+}
+
+void StreamSession::SetMaxCollectDuration(std::chrono::nanoseconds maxCollectDuration) {
+    _max_collect_duration = maxCollectDuration;
+    // Taking the lock makes sure a writer about to sleep on the previous
+    // deadline gets the notification.
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+    _writer_cond.notify_one();
+}
+
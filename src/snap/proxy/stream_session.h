@@ -0,0 +1,318 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2017 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <grpc++/grpc++.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <google/protobuf/arena.h>
+
+#include "snap/rpc/plugin.grpc.pb.h"
+#include "snap/rpc/plugin.pb.h"
+
+#include "snap/metric.h"
+#include "snap/mpsc_queue.h"
+#include "snap/namespace_index.h"
+#include "snap/plugin.h"
+
+#include "snap/proxy/compression.h"
+#include "snap/proxy/metric_coalescer.h"
+
+namespace Plugin {
+    namespace Proxy {
+        class StreamCollectorImpl;
+
+        /**
+        * MetricCopies are the copies of the metrics of one send. They are
+        * allocated on its arena, and all freed with it once no session
+        * holds on to them.
+        */
+        struct MetricCopies final {
+            explicit MetricCopies(size_t size) : metrics(size, nullptr) {}
+
+            google::protobuf::Arena arena;
+            std::vector<rpc::Metric*> metrics;
+        };
+
+        /**
+        * SharedMetrics is a send of the plugin on its way to the sessions.
+        * A metric is copied the first time a session takes it, and the copy
+        * is shared by all the sessions sending it. It only lives for one
+        * send_metrics call, on the calling thread.
+        *
+        * T is one of Plugin::Metric, Plugin::Metric* or rpc::Metric*, as
+        * defined by caller functions in plugin.h.
+        */
+        template<typename T>
+        class SharedMetrics final {
+        public:
+            explicit SharedMetrics(const std::vector<T>& metrics) : _metrics(metrics) {}
+
+            size_t size() const { return _metrics.size(); }
+
+            const rpc::Metric& get(size_t index) const {
+                return rpc_metric(_metrics[index]);
+            }
+
+            /**
+            * copy returns the shared copy of the metric at index.
+            */
+            rpc::Metric* copy(size_t index) {
+                if (!_copies) {
+                    _copies = std::make_shared<MetricCopies>(_metrics.size());
+                }
+                rpc::Metric*& copy = _copies->metrics[index];
+                if (!copy) {
+                    copy = google::protobuf::Arena::CreateMessage<rpc::Metric>(&_copies->arena);
+                    *copy = get(index);
+                }
+                return copy;
+            }
+
+            /**
+            * copies keeps the copies alive while a session holds on to them.
+            */
+            const std::shared_ptr<MetricCopies>& copies() const { return _copies; }
+
+        private:
+            static const rpc::Metric& rpc_metric(const Plugin::Metric& met) {
+                return *met.get_rpc_metric_ptr();
+            }
+            static const rpc::Metric& rpc_metric(const Plugin::Metric* met) {
+                return *met->get_rpc_metric_ptr();
+            }
+            static const rpc::Metric& rpc_metric(const rpc::Metric* met) {
+                return *met;
+            }
+
+            const std::vector<T>& _metrics;
+            std::shared_ptr<MetricCopies> _copies;
+        };
+
+        /**
+        * StreamSession is one StreamMetrics call: the stream and its context,
+        * the thread writing on the stream, and the buffer, limits and
+        * overflow accounting of the metrics sent on it.
+        *
+        * The session receives on the thread serving the call (@see receive),
+        * which ends on EOF or when the call is cancelled, so a session never
+        * outlives its stream.
+        */
+        class StreamSession final {
+        public:
+            typedef grpc::ServerReaderWriterInterface<rpc::CollectReply, rpc::CollectArg> Stream;
+
+            /**
+            * The session starts with the settings of plugin
+            * (@see StreamCollectorInterface::SetMaxCollectDuration and others).
+            */
+            StreamSession(StreamCollectorImpl* owner, Plugin::StreamCollectorInterface* plugin,
+                          grpc::ServerContext* context, Stream* stream,
+                          const Compression& compression);
+
+            ~StreamSession();
+
+            /**
+            * receiveRequest reads the stream until snapteld asks for metrics.
+            * @return false when the stream ended before.
+            */
+            bool receiveRequest();
+
+            /**
+            * receive reads the stream until it ends, on EOF or cancellation.
+            */
+            void receive();
+
+            /**
+            * close stops taking metrics, and lets the plugin threads waiting
+            * for room on the stream return. The writer thread still sends
+            * what was queued before, until it is stopped.
+            */
+            void close();
+
+            void startWriterThread();
+            void stopWriterThread();
+
+            /**
+            * sendMetrics queues the metrics this session subscribed to for
+            * the writer thread, which is the only one writing on the stream.
+            * Until snapteld requested metrics, the session takes none; a
+            * request listing no metrics subscribes to all of them.
+            *
+            * sendMetrics and sendErrorMessage may be called from any number of
+            * plugin threads at once.
+            */
+            template<typename T>
+            void sendMetrics(SharedMetrics<T>& metrics);
+            void sendErrorMessage(const std::string& msg);
+            /**
+            * cancelled tells whether the session was closed or the call
+            * cancelled: metrics sent to it are discarded.
+            */
+            bool cancelled() const;
+            bool wouldBlock() const;
+
+            /**
+            * requested returns the metrics snapteld requested on the stream.
+            */
+            std::vector<Plugin::Metric> requested() const;
+
+            void SetMaxCollectDuration(std::chrono::nanoseconds maxCollectDuration);
+            std::chrono::nanoseconds GetMaxCollectDuration() const {
+                return _max_collect_duration.load();
+            }
+            void SetMaxMetricsBuffer(size_t maxMetricsBuffer) {
+                _max_metrics_buffer = maxMetricsBuffer;
+            }
+            size_t GetMaxMetricsBuffer() const {
+                return _max_metrics_buffer.load();
+            }
+            void SetMaxInFlight(size_t maxInFlight);
+            size_t GetMaxInFlight() const {
+                return _max_in_flight.load();
+            }
+            void SetCoalesceMetrics(bool coalesceMetrics) {
+                _coalesce_metrics = coalesceMetrics;
+            }
+            void SetOverflowPolicy(Plugin::OverflowPolicy overflowPolicy) {
+                _overflow_policy = overflowPolicy;
+            }
+            void SetOverflowSampleRate(unsigned int overflowSampleRate) {
+                _overflow_sample_rate = overflowSampleRate;
+            }
+            uint64_t droppedMetrics() const {
+                return _dropped_metrics.load();
+            }
+
+        private:
+            StreamCollectorImpl* _owner;
+            Plugin::StreamCollectorInterface* _plugin;
+            grpc::ServerContext* _context;
+            Stream* _stream;
+            Compression _compression;
+            std::atomic<bool> _closed;
+
+            std::atomic<size_t> _max_metrics_buffer;
+            std::atomic<size_t> _max_in_flight;
+            std::atomic<Plugin::OverflowPolicy> _overflow_policy;
+            std::atomic<unsigned int> _overflow_sample_rate;
+            std::atomic<bool> _coalesce_metrics;
+            std::atomic<std::chrono::nanoseconds> _max_collect_duration;
+
+            // The reply being batched is only used by the writer thread. It
+            // doesn't own its metrics: they are either borrowed from shared
+            // copies, kept alive by _borrowed, or coalesced ones held by
+            // _owned, until the reply is sent.
+            rpc::CollectReply _collect_reply;
+            rpc::MetricsReply *_metrics_reply;
+            rpc::ErrReply *_err_reply;
+            std::vector<std::shared_ptr<MetricCopies>> _borrowed;
+            std::vector<std::unique_ptr<rpc::Metric>> _owned;
+            std::chrono::steady_clock::time_point _collect_duration_start;
+
+            // The requested metrics, and their namespaces to select the
+            // metrics sent to the session.
+            mutable std::shared_timed_mutex _subscription_mutex;
+            std::vector<Plugin::Metric> _requested;
+            NamespaceIndex<bool> _subscription;
+            bool _subscribed;
+
+            /**
+            * QueuedSend is a send queued by a plugin thread: the metrics
+            * selected for the session, borrowed from the shared copies, or
+            * an error.
+            */
+            struct QueuedSend {
+                std::shared_ptr<MetricCopies> copies;
+                std::vector<rpc::Metric*> metrics;
+                std::string error;
+            };
+            MpscQueue<QueuedSend> _send_queue;
+
+            // _writer_mutex guards _writer_stopping and the sleep of the
+            // writer: producers only take it to wake the writer up when
+            // _writer_idle is set.
+            std::mutex _writer_mutex;
+            std::condition_variable _writer_cond;
+            std::atomic<bool> _writer_idle;
+            std::thread _writer_thread;
+            bool _writer_stopping;
+
+            // Number of queued replies not processed by the writer yet.
+            // Producers wait on _in_flight_cond when it reaches _max_in_flight.
+            std::atomic<size_t> _in_flight;
+            std::mutex _in_flight_mutex;
+            std::condition_variable _in_flight_cond;
+
+            // Overflow accounting
+            std::atomic<uint64_t> _dropped_metrics;
+            std::atomic<uint64_t> _overflow_sends;
+
+            // The latest metric per namespace, when coalescing metrics or with
+            // OverflowPolicy::CoalesceLatest. Producers copy metrics straight
+            // into it, and set _coalesced_pending for the writer to take them
+            // before the deadline. Queuing a send removes the metrics it
+            // supersedes, so the writer can take them after the queued sends.
+            std::mutex _coalesce_mutex;
+            MetricCoalescer _coalescer;
+            std::atomic<bool> _coalesced_pending;
+
+            /**
+            * select adds the indexes of the metrics the session subscribed
+            * to to selected.
+            * @return false when there is none.
+            */
+            template<typename T>
+            bool select(const SharedMetrics<T>& metrics, std::vector<size_t>& selected) const;
+
+            enum class Admission { Queue, Drop, Coalesce };
+            /**
+            * admit applies the overflow policy to a send of count metrics,
+            * and takes its in-flight slot when it is to be queued.
+            */
+            Admission admit(size_t count);
+            void wakeWriter();
+            template<typename T>
+            void coalesce(const SharedMetrics<T>& metrics,
+                          const std::vector<size_t>& selected, bool overflow);
+            void takeCoalesced();
+            void enqueue(QueuedSend send);
+            bool acquireInFlight();
+            bool overLimit(const QueuedSend& send) const;
+            void releaseInFlight();
+
+            /**
+            * writeMetrics runs on the writer thread: it batches the queued
+            * metrics into CollectReply messages of _max_metrics_buffer
+            * metrics, and sends a partial batch once _max_collect_duration
+            * has elapsed since the last send, whether or not the plugin
+            * sends metrics again.
+            */
+            void writeMetrics();
+            void bufferSend(QueuedSend& send);
+            void bufferMetric(rpc::Metric* metric);
+            bool sendAndClearMetricsReply();
+            void clearMetricsReply();
+            void receiveReply(const rpc::CollectArg& arg);
+        };
+    }  // namespace Proxy
+}  // namespace Plugin
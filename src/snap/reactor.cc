@@ -0,0 +1,268 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/reactor.h"
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <string>
+
+#include "snap/plugin.h"
+
+using Plugin::PluginException;
+using Plugin::Reactor;
+
+namespace {
+    // The eventfd is registered under handle 0, sources from 1 on
+    const Reactor::Handle wake_handle = 0;
+    const int max_events = 64;
+
+    std::string error_string(const std::string& what) {
+        return what + ": " + std::strerror(errno);
+    }
+}
+
+Reactor::Reactor() : _next_handle(wake_handle + 1), _running(false), _stopping(false) {
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epoll_fd < 0) {
+        throw PluginException(error_string("Cannot create epoll instance"));
+    }
+    _event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_event_fd < 0) {
+        std::string err = error_string("Cannot create eventfd");
+        close(_epoll_fd);
+        throw PluginException(err);
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = wake_handle;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _event_fd, &event) < 0) {
+        std::string err = error_string("Cannot watch eventfd");
+        close(_event_fd);
+        close(_epoll_fd);
+        throw PluginException(err);
+    }
+}
+
+Reactor::Source::~Source() {
+    if (timer) {
+        close(fd);
+    }
+}
+
+Reactor::~Reactor() {
+    stop();
+    _sources.clear();
+    close(_event_fd);
+    close(_epoll_fd);
+}
+
+Reactor::Handle Reactor::add_fd(int fd, uint32_t events, FdCallback callback) {
+    std::shared_ptr<Source> source(new Source{fd, false, true, std::move(callback)});
+    return add(fd, events, std::move(source));
+}
+
+Reactor::Handle Reactor::add_timer(std::chrono::nanoseconds interval, Callback callback,
+                                   bool repeat) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        throw PluginException(error_string("Cannot create timer"));
+    }
+    // A zero it_value disarms the timer: fire as soon as possible instead
+    std::chrono::nanoseconds first = std::max(interval, std::chrono::nanoseconds(1));
+    itimerspec spec{};
+    spec.it_value.tv_sec = first.count() / 1000000000;
+    spec.it_value.tv_nsec = first.count() % 1000000000;
+    if (repeat) {
+        spec.it_interval = spec.it_value;
+    }
+    if (timerfd_settime(fd, 0, &spec, nullptr) < 0) {
+        std::string err = error_string("Cannot arm timer");
+        close(fd);
+        throw PluginException(err);
+    }
+    std::shared_ptr<Source> source(new Source{fd, true, repeat,
+        [callback](uint32_t) { callback(); }});
+    return add(fd, EPOLLIN, std::move(source));
+}
+
+Reactor::Handle Reactor::add(int fd, uint32_t events, std::shared_ptr<Source> source) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Handle handle = _next_handle++;
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = handle;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        throw PluginException(error_string("Cannot watch file descriptor " + std::to_string(fd)));
+    }
+    _sources.emplace(handle, std::move(source));
+    return handle;
+}
+
+void Reactor::remove(Handle handle) {
+    // The source is released out of the lock, as its callback may hold
+    // anything
+    std::shared_ptr<Source> source;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _sources.find(handle);
+    if (it == _sources.end()) {
+        return;
+    }
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, it->second->fd, nullptr);
+    source = std::move(it->second);
+    _sources.erase(it);
+}
+
+void Reactor::post(Callback callback) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _posted.push_back(std::move(callback));
+    }
+    wake();
+}
+
+void Reactor::call(const Callback& callback) {
+    std::packaged_task<void()> task(callback);
+    std::future<void> done = task.get_future();
+    bool posted = false;
+    {
+        // The reactor runs the callbacks posted before it stops
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_running.load() && !in_reactor_thread()) {
+            _posted.push_back([&task]() { task(); });
+            posted = true;
+        }
+    }
+    if (posted) {
+        wake();
+    } else {
+        task();
+    }
+    // Rethrows what callback threw
+    done.get();
+}
+
+void Reactor::start() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_thread.joinable()) {
+        return;
+    }
+    _running = true;
+    _thread = std::thread(&Reactor::run, this);
+}
+
+void Reactor::run() {
+    _reactor_thread = std::this_thread::get_id();
+    _running = true;
+    epoll_event events[max_events];
+    while (!_stopping.load()) {
+        int count = epoll_wait(_epoll_fd, events, max_events, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cout << "Error: " << error_string("epoll_wait failed") << std::endl;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.u64 == wake_handle) {
+                uint64_t value;
+                while (read(_event_fd, &value, sizeof(value)) > 0) {}
+                run_posted();
+            } else {
+                dispatch(events[i].data.u64, events[i].events);
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+    }
+    run_posted();
+    _stopping = false;
+    _reactor_thread = std::thread::id();
+}
+
+void Reactor::stop() {
+    if (_running.load()) {
+        _stopping = true;
+        wake();
+    }
+    if (_thread.joinable() && !in_reactor_thread()) {
+        _thread.join();
+    }
+}
+
+bool Reactor::running() const {
+    return _running.load();
+}
+
+bool Reactor::in_reactor_thread() const {
+    return _reactor_thread.load() == std::this_thread::get_id();
+}
+
+void Reactor::dispatch(Handle handle, uint32_t events) {
+    std::shared_ptr<Source> source;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _sources.find(handle);
+        if (it == _sources.end()) {
+            // Removed by a callback of the same batch
+            return;
+        }
+        source = it->second;
+    }
+    if (source->timer) {
+        uint64_t expirations;
+        if (read(source->fd, &expirations, sizeof(expirations)) < 0) {
+            return;
+        }
+        if (!source->repeat) {
+            remove(handle);
+        }
+    }
+    try {
+        source->callback(events);
+    } catch (std::exception& e) {
+        std::cout << "Error: " << e.what() << std::endl;
+    }
+}
+
+void Reactor::run_posted() {
+    std::vector<Callback> posted;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        posted.swap(_posted);
+    }
+    for (Callback& callback : posted) {
+        try {
+            callback();
+        } catch (std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+    }
+}
+
+void Reactor::wake() {
+    uint64_t one = 1;
+    if (write(_event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        std::cout << "Error: " << error_string("Cannot wake reactor") << std::endl;
+    }
+}
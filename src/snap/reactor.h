@@ -0,0 +1,153 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Plugin {
+    /**
+    * Reactor runs callbacks on a single thread when file descriptors are
+    * ready, timers expire or callbacks are posted, multiplexing them all with
+    * epoll: a timer is a timerfd, and posted callbacks are signalled on an
+    * eventfd.
+    * Sources may be added and removed from any thread, including from the
+    * callbacks. Callbacks must not block, as they hold up all the others.
+    */
+    class Reactor final {
+    public:
+        typedef std::function<void()> Callback;
+
+        /**
+        * FdCallback is given the epoll events the file descriptor is
+        * ready for (EPOLLIN, EPOLLOUT, EPOLLERR...).
+        */
+        typedef std::function<void(uint32_t events)> FdCallback;
+
+        /**
+        * Handle identifies a source to remove it. Handles are never reused.
+        */
+        typedef uint64_t Handle;
+
+        /**
+        * @throws PluginException when the epoll or eventfd file descriptors
+        * cannot be created.
+        */
+        Reactor();
+        ~Reactor();
+
+        Reactor(const Reactor&) = delete;
+        Reactor& operator=(const Reactor&) = delete;
+
+        /**
+        * add_fd calls callback whenever fd is ready for events (e.g.
+        * EPOLLIN), level-triggered. The reactor doesn't own fd, which must
+        * stay open until the source is removed.
+        * @throws PluginException when fd cannot be watched.
+        */
+        Handle add_fd(int fd, uint32_t events, FdCallback callback);
+
+        /**
+        * add_timer calls callback once interval has elapsed, then every
+        * interval when repeat is set. A one-shot timer is removed once it
+        * fired. Expirations missed while callbacks ran are coalesced into a
+        * single call.
+        * @throws PluginException when the timer cannot be created.
+        */
+        Handle add_timer(std::chrono::nanoseconds interval, Callback callback,
+                         bool repeat = true);
+
+        /**
+        * remove stops watching a source. Called on the reactor thread, its
+        * callback is never called afterwards; called from another thread, a
+        * call in progress may still complete.
+        */
+        void remove(Handle handle);
+
+        /**
+        * post runs callback once on the reactor thread, after the callbacks
+        * posted before it.
+        */
+        void post(Callback callback);
+
+        /**
+        * call runs callback on the reactor thread and waits for it: right
+        * away when called from the reactor thread, or when the reactor isn't
+        * running.
+        */
+        void call(const Callback& callback);
+
+        /**
+        * start runs the reactor on a thread of its own, until stop. It does
+        * nothing when that thread already runs.
+        */
+        void start();
+
+        /**
+        * run runs the reactor on the calling thread, until stop.
+        */
+        void run();
+
+        /**
+        * stop makes the reactor return once the callbacks being run are
+        * done, and joins its thread when it was started. Sources stay
+        * registered, so the reactor may be run again.
+        */
+        void stop();
+
+        bool running() const;
+        bool in_reactor_thread() const;
+
+    private:
+        // Timers own their timerfd, closed once no callback can use it
+        struct Source {
+            int fd;
+            bool timer;
+            bool repeat;
+            FdCallback callback;
+
+            ~Source();
+        };
+
+        Handle add(int fd, uint32_t events, std::shared_ptr<Source> source);
+        void dispatch(Handle handle, uint32_t events);
+        void run_posted();
+        void wake();
+
+        int _epoll_fd;
+        int _event_fd;
+
+        // _mutex guards the sources, the posted callbacks and whether
+        // the reactor runs to take them
+        std::mutex _mutex;
+        std::unordered_map<Handle, std::shared_ptr<Source>> _sources;
+        std::vector<Callback> _posted;
+        Handle _next_handle;
+
+        std::thread _thread;
+        std::atomic<std::thread::id> _reactor_thread;
+        std::atomic<bool> _running;
+        std::atomic<bool> _stopping;
+    };
+
+}   // namespace Plugin
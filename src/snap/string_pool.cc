@@ -0,0 +1,56 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/string_pool.h"
+
+using Plugin::StringPool;
+
+const std::string* StringPool::intern(const std::string& str) {
+    if (str.empty()) {
+        return empty();
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _strings.find(str);
+    if (it == _strings.end()) {
+        it = _strings.insert(str).first;
+    }
+    // std::unordered_set nodes are never moved, so pointers to them are stable.
+    return &*it;
+}
+
+const std::string* StringPool::intern(std::string&& str) {
+    if (str.empty()) {
+        return empty();
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _strings.find(str);
+    if (it == _strings.end()) {
+        it = _strings.insert(std::move(str)).first;
+    }
+    return &*it;
+}
+
+size_t StringPool::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _strings.size();
+}
+
+StringPool& StringPool::global() {
+    static StringPool* pool = new StringPool;
+    return *pool;
+}
+
+const std::string* StringPool::empty() {
+    static const std::string* empty_string = new std::string;
+    return empty_string;
+}
@@ -0,0 +1,68 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace Plugin {
+
+    /**
+    * StringPool interns strings: equal strings added to the pool share a
+    * single copy, so they can be held (and compared) through a pointer.
+    * It backs the static values, names and descriptions of namespace
+    * elements, which repeat across the metrics of a plugin.
+    *
+    * Pooled strings are never released: the pool is meant for bounded
+    * vocabularies such as the metric catalog, never for collected values.
+    */
+    class StringPool final {
+    public:
+        StringPool() = default;
+        ~StringPool() = default;
+
+        StringPool(const StringPool&) = delete;
+        StringPool& operator=(const StringPool&) = delete;
+
+        /**
+        * intern returns the pooled copy of str, adding it first if needed.
+        * The returned pointer is valid for the lifetime of the pool.
+        */
+        const std::string* intern(const std::string& str);
+        const std::string* intern(std::string&& str);
+
+        /**
+        * size returns the number of distinct strings in the pool.
+        */
+        size_t size() const;
+
+        /**
+        * global returns the process-wide pool used by NamespaceElement.
+        * It is never destroyed, so interned strings outlive static objects.
+        */
+        static StringPool& global();
+
+        /**
+        * empty returns the empty string shared by all pools, without locking.
+        */
+        static const std::string* empty();
+
+    private:
+        mutable std::mutex _mutex;
+        std::unordered_set<std::string> _strings;
+    };
+
+}   // namespace Plugin
@@ -0,0 +1,70 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Plugin {
+    /**
+    * ThreadPool runs tasks on a fixed number of worker threads.
+    * Tasks are queued in submission order; the destructor lets the queued
+    * tasks finish, then joins the workers.
+    */
+    class ThreadPool final {
+    public:
+        explicit ThreadPool(unsigned int threads);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+        * submit queues f to be run by a worker.
+        * @return a future holding the result of f, or the exception it threw.
+        */
+        template<typename F>
+        std::future<typename std::result_of<F()>::type> submit(F&& f) {
+            typedef typename std::result_of<F()>::type Result;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+            std::future<Result> result = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _tasks.emplace([task]() { (*task)(); });
+            }
+            _cond.notify_one();
+            return result;
+        }
+
+        unsigned int size() const;
+
+    private:
+        void run();
+
+        std::vector<std::thread> _threads;
+        std::queue<std::function<void()>> _tasks;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        bool _stopping;
+    };
+
+}   // namespace Plugin
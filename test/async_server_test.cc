@@ -0,0 +1,155 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <snap/plugin.h>
+#include <snap/proxy/async_server.h>
+#include <snap/proxy/collector_proxy.h>
+#include "gmock/gmock.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mocks.h"
+
+using Plugin::Metric;
+using Plugin::Proxy::AsyncServer;
+using Plugin::Proxy::CollectorImpl;
+using ::testing::Return;
+using ::testing::_;
+using ::testing::Invoke;
+using std::vector;
+
+namespace {
+    /**
+    * LocalServer serves collector on an async server, as the exporter does
+    * when Meta::async_server_enabled is set, and connects a stub to it over
+    * loopback.  The in-process transport closes its streams as soon as the
+    * server shuts down, so it can't show calls being finished on shutdown.
+    */
+    class LocalServer {
+    public:
+        explicit LocalServer(MockCollector* collector) : _impl(collector) {
+            int port = 0;
+            _builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &port);
+            _async.reset(new AsyncServer(Plugin::Collector, &_impl, &_builder, 1, 2));
+            _server = _builder.BuildAndStart();
+            _async->Start(_server.get());
+            stub = rpc::Collector::NewStub(grpc::CreateChannel(
+                "127.0.0.1:" + std::to_string(port), grpc::InsecureChannelCredentials()));
+        }
+
+        /**
+        * stop destroys the async server, which shuts the server down.
+        */
+        void stop() {
+            _async.reset();
+        }
+
+        std::unique_ptr<rpc::Collector::Stub> stub;
+
+    private:
+        CollectorImpl _impl;
+        grpc::ServerBuilder _builder;
+        std::unique_ptr<grpc::Server> _server;
+        std::unique_ptr<AsyncServer> _async;
+    };
+
+    rpc::MetricsArg collect_request(const Metric& metric) {
+        rpc::MetricsArg arg;
+        *arg.add_metrics() = *metric.get_rpc_metric_ptr();
+        return arg;
+    }
+}
+
+TEST(AsyncServerTest, ServesCollectorCalls) {
+    MockCollector mockee;
+    std::thread::id collecting;
+    EXPECT_CALL(mockee, collect_metrics(_))
+        .WillRepeatedly(Invoke([&](vector<Metric>& metrics) {
+            collecting = std::this_thread::get_id();
+            for (Metric& met : metrics)
+                met.set_data(std::string("hop"));
+            return metrics;
+        }));
+    EXPECT_CALL(mockee, get_config_policy())
+        .WillOnce(Return(mockee.fake_policy));
+    LocalServer server(&mockee);
+
+    // Each call is accepted while the previous one is handled, on the executor
+    for (int i = 0; i < 3; i++) {
+        grpc::ClientContext context;
+        rpc::MetricsReply reply;
+        grpc::Status status = server.stub->CollectMetrics(
+            &context, collect_request(mockee.fake_metric), &reply);
+        EXPECT_EQ(grpc::StatusCode::OK, status.error_code());
+        ASSERT_EQ(1, reply.metrics_size());
+        EXPECT_EQ("hop", reply.metrics(0).string_data());
+        EXPECT_NE(std::this_thread::get_id(), collecting);
+    }
+
+    grpc::ClientContext ping_context;
+    rpc::ErrReply ping_reply;
+    EXPECT_TRUE(server.stub->Ping(&ping_context, rpc::Empty(), &ping_reply).ok());
+
+    grpc::ClientContext policy_context;
+    rpc::GetConfigPolicyReply policy_reply;
+    EXPECT_TRUE(server.stub->GetConfigPolicy(&policy_context, rpc::Empty(), &policy_reply).ok());
+    EXPECT_EQ(1, policy_reply.string_policy_size());
+}
+
+TEST(AsyncServerTest, StopFinishesCallsInFlight) {
+    MockCollector mockee;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool collecting = false;
+    bool released = false;
+    EXPECT_CALL(mockee, collect_metrics(_))
+        .WillOnce(Invoke([&](vector<Metric>& metrics) {
+            std::unique_lock<std::mutex> lock(mutex);
+            collecting = true;
+            cond.notify_all();
+            cond.wait(lock, [&]() { return released; });
+            return metrics;
+        }));
+    LocalServer server(&mockee);
+
+    grpc::Status status;
+    rpc::MetricsReply reply;
+    std::thread call([&]() {
+        grpc::ClientContext context;
+        status = server.stub->CollectMetrics(&context, collect_request(mockee.fake_metric), &reply);
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(cond.wait_for(lock, std::chrono::seconds(5), [&]() { return collecting; }));
+    }
+
+    // The call is let through while the server is shutting down: it's
+    // finished, and the calls waiting to be accepted are dropped.
+    std::thread release([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::lock_guard<std::mutex> lock(mutex);
+        released = true;
+        cond.notify_all();
+    });
+    server.stop();
+    release.join();
+    call.join();
+    EXPECT_EQ(grpc::StatusCode::OK, status.error_code()) << status.error_message();
+    EXPECT_EQ(1, reply.metrics_size());
+}
@@ -16,8 +16,12 @@ limitations under the License.
 #include <snap/proxy/collector_proxy.h>
 #include "gmock/gmock.h"
 
+#include <chrono>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "mocks.h"
@@ -100,6 +104,123 @@ TEST(CollectorProxySuccessTest, CollectMetricsWorks) {
     EXPECT_EQ("/foo/bar", ns_str);
 }
 
+TEST(CollectorProxySuccessTest, CollectMetricsCompressesLargeReplies) {
+    MockCollector mockee;
+    ON_CALL(mockee, collect_metrics(_))
+            .WillByDefault(Invoke([] (vector<Metric> &metrics) { return metrics; }));
+    Plugin::Proxy::Compression compression(GRPC_COMPRESS_GZIP, 1024);
+    CollectorImpl collector(&mockee);
+    collector.SetCompression(compression);
+
+    rpc::MetricsReply small_resp;
+    *small_resp.add_metrics() = *mockee.fake_metric.get_rpc_metric_ptr();
+    EXPECT_FALSE(compression.applies(small_resp));
+    EXPECT_TRUE(compression.write_options(small_resp).get_no_compression());
+
+    grpc::ServerContext context;
+    rpc::MetricsArg args;
+    rpc::MetricsReply resp;
+    for (int i = 0; i < 1000; i++) {
+        *args.add_metrics() = *mockee.fake_metric.get_rpc_metric_ptr();
+    }
+    grpc::Status status = collector.CollectMetrics(&context, &args, &resp);
+    EXPECT_EQ(grpc::StatusCode::OK, status.error_code());
+    EXPECT_TRUE(compression.applies(resp));
+    EXPECT_EQ(GRPC_COMPRESS_GZIP, context.compression_algorithm());
+}
+
+TEST(CollectorProxySuccessTest, CollectMetricsDoesNotCopyMetrics) {
+    MockCollector mockee;
+    rpc::MetricsReply resp;
+    grpc::Status status;
+    rpc::MetricsArg args;
+    vector<const rpc::Metric*> collected;
+    const int metrics_count = 1000;
+    for (int i = 0; i < metrics_count; i++) {
+        *args.add_metrics() = *mockee.fake_metric.get_rpc_metric_ptr();
+    }
+    auto reporter = [&] (vector<Metric> &metrics) {
+        vector<Metric> result;
+        result.reserve(2 * metrics.size());
+        for (Metric& met : metrics) {
+            // borrowed from the request
+            result.emplace_back(met.get_rpc_metric_ptr());
+            result.back().set_data(int64_t(1));
+            // owned by the plugin
+            result.emplace_back(Namespace({"foo", "baz"}), "", "");
+            result.back().set_data(int64_t(2));
+            collected.push_back(result.back().get_rpc_metric_ptr());
+        }
+        return result;
+    };
+
+    ON_CALL(mockee, collect_metrics(_))
+            .WillByDefault(Invoke(reporter));
+    EXPECT_NO_THROW({
+                        CollectorImpl collector(&mockee);
+                        status = collector.CollectMetrics(nullptr, &args, &resp);
+                    });
+    EXPECT_EQ(grpc::StatusCode::OK, status.error_code());
+    ASSERT_EQ(2 * metrics_count, resp.metrics_size());
+    int copies = 0;
+    for (int i = 0; i < metrics_count; i++) {
+        // borrowed metrics were swapped out of the request
+        if (args.metrics(i).namespace__size() != 0) copies++;
+        EXPECT_EQ(1, resp.metrics(2 * i).int64_data());
+        EXPECT_EQ("/foo/bar", extract_ns(resp.metrics(2 * i)));
+        // owned metrics were handed over as they are
+        if (&resp.metrics(2 * i + 1) != collected[i]) copies++;
+        EXPECT_EQ(2, resp.metrics(2 * i + 1).int64_data());
+    }
+    EXPECT_EQ(0, copies);
+}
+
+TEST(CollectorProxySuccessTest, CollectMetricsInParallelWorks) {
+    MockCollector mockee;
+    mockee.SetCollectWorkers(3);
+    rpc::MetricsReply resp;
+    grpc::Status status;
+    rpc::MetricsArg args;
+    const int partitions_count = 8;
+    const int metrics_count = 4;
+    for (int i = 0; i < metrics_count; i++) {
+        for (int p = 0; p < partitions_count; p++) {
+            Metric met(Namespace({"foo", std::to_string(p), std::to_string(i)}), "", "");
+            *args.add_metrics() = *met.get_rpc_metric_ptr();
+        }
+    }
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    auto reporter = [&] (vector<Metric> &metrics) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads.insert(std::this_thread::get_id());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        for (Metric& met : metrics) {
+            met.set_data(int64_t(metrics.size()));
+        }
+        return metrics;
+    };
+
+    EXPECT_CALL(mockee, collect_metrics(_))
+            .Times(partitions_count)
+            .WillRepeatedly(Invoke(reporter));
+    EXPECT_NO_THROW({
+                        CollectorImpl collector(&mockee);
+                        status = collector.CollectMetrics(nullptr, &args, &resp);
+                    });
+    EXPECT_EQ(grpc::StatusCode::OK, status.error_code());
+    EXPECT_LT(1, threads.size());
+    ASSERT_EQ(partitions_count * metrics_count, resp.metrics_size());
+    for (int i = 0; i < resp.metrics_size(); i++) {
+        // each partition's metrics come together, in request order
+        EXPECT_EQ(std::to_string(i / metrics_count), resp.metrics(i).namespace_(1).value());
+        EXPECT_EQ(std::to_string(i % metrics_count), resp.metrics(i).namespace_(2).value());
+        EXPECT_EQ(metrics_count, resp.metrics(i).int64_data());
+    }
+}
+
 TEST(CollectorProxySuccessTest, PingWorks) {
     MockCollector mockee;
     rpc::ErrReply resp;
@@ -169,3 +290,30 @@ TEST(CollectorProxyFailureTest, CollectMetricsReportsError) {
     EXPECT_EQ(grpc::StatusCode::UNKNOWN, status.error_code());
     EXPECT_EQ("nothing to look at", status.error_message());
 }
+
+TEST(CollectorProxyFailureTest, CollectMetricsInParallelReportsError) {
+    MockCollector mockee;
+    mockee.SetCollectWorkers(2);
+    rpc::MetricsReply resp;
+    grpc::Status status;
+    rpc::MetricsArg args;
+    for (int p = 0; p < 4; p++) {
+        Metric met(Namespace({"foo", std::to_string(p), "bar"}), "", "");
+        *args.add_metrics() = *met.get_rpc_metric_ptr();
+    }
+    auto reporter = [&] (vector<Metric> &metrics) {
+        if (metrics.front().ns()[1].get_value() == "2") {
+            throw Plugin::PluginException("nothing to look at");
+        }
+        return metrics;
+    };
+
+    ON_CALL(mockee, collect_metrics(_))
+            .WillByDefault(Invoke(reporter));
+    EXPECT_NO_THROW({
+                        CollectorImpl collector(&mockee);
+                        status = collector.CollectMetrics(nullptr, &args, &resp);
+                    });
+    EXPECT_EQ(grpc::StatusCode::UNKNOWN, status.error_code());
+    EXPECT_EQ("nothing to look at", status.error_message());
+}
@@ -0,0 +1,104 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/metric.h"
+#include "snap/metric_batch.h"
+#include "snap/plugin.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+
+using std::string;
+using std::vector;
+using Plugin::Metric;
+using Plugin::MetricBatch;
+using Plugin::Namespace;
+using Plugin::PluginException;
+
+
+namespace {
+    Metric prototype() {
+        Metric metric(Namespace({"intel", "procfs"})
+                        .add_dynamic_element("cpu", "cpu id")
+                        .add_static_element("utilization"),
+                      "percent", "cpu utilization");
+        metric.add_tag({"source", "procfs"});
+        metric.set_data(1.5);
+        return metric;
+    }
+}
+
+TEST(MetricBatchTest, AddWorks) {
+    MetricBatch batch(prototype());
+
+    batch.add("0", 10.0);
+    batch.add("1", int64_t(11));
+    batch.add("2");
+    ASSERT_EQ(3, batch.size());
+
+    vector<Metric> metrics;
+    batch.move_to(metrics);
+    EXPECT_EQ(0, batch.size());
+    ASSERT_EQ(3, metrics.size());
+
+    EXPECT_EQ("intel/procfs/0/utilization", metrics[0].ns().get_string());
+    EXPECT_EQ("cpu", metrics[0].ns()[2].get_name());
+    EXPECT_EQ("percent", metrics[0].get_rpc_metric_ptr()->unit());
+    EXPECT_EQ("cpu utilization", metrics[0].get_rpc_metric_ptr()->description());
+    EXPECT_EQ("procfs", metrics[0].tags().at("source"));
+    EXPECT_EQ(10.0, metrics[0].get_float64_data());
+
+    EXPECT_EQ("intel/procfs/1/utilization", metrics[1].ns().get_string());
+    EXPECT_EQ(11, metrics[1].get_int64_data());
+
+    EXPECT_EQ("intel/procfs/2/utilization", metrics[2].ns().get_string());
+    EXPECT_EQ(Metric::DataType::NotSet, metrics[2].data_type());
+
+    for (const Metric& metric : metrics) {
+        EXPECT_TRUE(metric.owns_rpc_metric_ptr());
+    }
+}
+
+TEST(MetricBatchTest, MoveToReplyDoesNotCopy) {
+    MetricBatch batch(prototype(), 2);
+    vector<const rpc::Metric*> added;
+    for (int i = 0; i < 100; i++) {
+        added.push_back(batch.add(std::to_string(i), uint64_t(i)).get_rpc_metric_ptr());
+    }
+
+    rpc::MetricsReply reply;
+    batch.move_to(&reply);
+    ASSERT_EQ(100, reply.metrics_size());
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(added[i], &reply.metrics(i));
+    }
+
+    added.clear();
+    for (int i = 0; i < 10; i++) {
+        added.push_back(batch.add(std::to_string(i), uint64_t(i)).get_rpc_metric_ptr());
+    }
+    batch.move_to(&reply);
+    ASSERT_EQ(110, reply.metrics_size());
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(added[i], &reply.metrics(100 + i));
+        EXPECT_EQ(std::to_string(i), reply.metrics(100 + i).namespace_(2).value());
+    }
+}
+
+TEST(MetricBatchTest, StaticPrototypeThrows) {
+    Metric metric(Namespace({"intel", "procfs", "cpu"}), "", "");
+    EXPECT_THROW(MetricBatch batch(metric), PluginException);
+    EXPECT_THROW(MetricBatch batch(metric, 3), PluginException);
+}
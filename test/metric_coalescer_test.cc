@@ -0,0 +1,82 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/metric.h"
+#include "snap/proxy/metric_coalescer.h"
+#include "gtest/gtest.h"
+
+#include <string>
+
+
+using google::protobuf::RepeatedPtrField;
+using Plugin::Metric;
+using Plugin::Namespace;
+using Plugin::Proxy::MetricCoalescer;
+
+
+namespace {
+    rpc::Metric gauge(const std::string& name, int64_t value) {
+        Metric metric(Namespace({"intel", "gauge", name}), "", "");
+        metric.set_data(value);
+        return *metric.get_rpc_metric_ptr();
+    }
+}
+
+TEST(MetricCoalescerTest, KeepsLatestValuePerNamespace) {
+    MetricCoalescer coalescer;
+    EXPECT_FALSE(coalescer.add(gauge("a", 1)));
+    EXPECT_FALSE(coalescer.add(gauge("b", 2)));
+    EXPECT_TRUE(coalescer.add(gauge("a", 3)));
+    EXPECT_TRUE(coalescer.add_allocated(new rpc::Metric(gauge("b", 4))));
+    EXPECT_FALSE(coalescer.add_allocated(new rpc::Metric(gauge("c", 5))));
+    ASSERT_EQ(3, coalescer.size());
+
+    RepeatedPtrField<rpc::Metric> metrics;
+    *metrics.Add() = gauge("z", 0);
+    coalescer.move_to(&metrics);
+    EXPECT_TRUE(coalescer.empty());
+    ASSERT_EQ(4, metrics.size());
+    // In the order namespaces were first added
+    EXPECT_EQ("a", metrics.Get(1).namespace_(2).value());
+    EXPECT_EQ(3, metrics.Get(1).int64_data());
+    EXPECT_EQ("b", metrics.Get(2).namespace_(2).value());
+    EXPECT_EQ(4, metrics.Get(2).int64_data());
+    EXPECT_EQ(5, metrics.Get(3).int64_data());
+
+    // The buffer starts over once moved out
+    EXPECT_FALSE(coalescer.add(gauge("a", 6)));
+    EXPECT_EQ(1, coalescer.size());
+}
+
+TEST(MetricCoalescerTest, RemovesBufferedNamespace) {
+    MetricCoalescer coalescer;
+    coalescer.add(gauge("a", 1));
+    coalescer.add(gauge("b", 2));
+    coalescer.add(gauge("c", 3));
+    EXPECT_TRUE(coalescer.remove(gauge("a", 4)));
+    EXPECT_FALSE(coalescer.remove(gauge("a", 5)));
+    ASSERT_EQ(2, coalescer.size());
+
+    // The metrics left are still found
+    EXPECT_TRUE(coalescer.add(gauge("c", 6)));
+    EXPECT_TRUE(coalescer.add(gauge("b", 7)));
+    EXPECT_FALSE(coalescer.add(gauge("a", 8)));
+
+    RepeatedPtrField<rpc::Metric> metrics;
+    coalescer.move_to(&metrics);
+    ASSERT_EQ(3, metrics.size());
+    EXPECT_EQ("c", metrics.Get(0).namespace_(2).value());
+    EXPECT_EQ(6, metrics.Get(0).int64_data());
+    EXPECT_EQ(7, metrics.Get(1).int64_data());
+    EXPECT_EQ(8, metrics.Get(2).int64_data());
+}
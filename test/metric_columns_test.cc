@@ -0,0 +1,89 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/metric.h"
+#include "snap/metric_columns.h"
+#include "snap/plugin.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using std::string;
+using std::vector;
+using Plugin::Metric;
+using Plugin::MetricColumns;
+using Plugin::Namespace;
+using Plugin::PluginException;
+
+
+namespace {
+    Metric prototype() {
+        Metric metric(Namespace({"intel", "net"})
+                        .add_dynamic_element("interface")
+                        .add_static_element("bytes"),
+                      "B", "received bytes");
+        metric.add_tag({"host", "node1"});
+        return metric;
+    }
+}
+
+TEST(MetricColumnsTest, RoundTripWorks) {
+    system_clock::time_point now = system_clock::now();
+    MetricColumns<uint64_t> columns(prototype());
+    EXPECT_EQ(2, columns.dynamic_index());
+    columns.push_back("eth0", 10, now);
+    columns.push_back("eth1", 20, now + seconds(1));
+
+    vector<Metric> metrics;
+    columns.to_metrics(metrics);
+    ASSERT_EQ(2, metrics.size());
+    EXPECT_EQ("intel/net/eth1/bytes", metrics[1].ns().get_string());
+    EXPECT_EQ(20, metrics[1].get_uint64_data());
+    EXPECT_EQ(now + seconds(1), metrics[1].timestamp());
+    EXPECT_EQ("node1", metrics[1].tags().at("host"));
+
+    MetricColumns<uint64_t> back = MetricColumns<uint64_t>::from_metrics(metrics);
+    ASSERT_EQ(2, back.size());
+    EXPECT_EQ((vector<string>{"eth0", "eth1"}), back.dynamic_values());
+    EXPECT_EQ((vector<uint64_t>{10, 20}), back.values());
+    EXPECT_EQ(now, back.timestamps()[0]);
+}
+
+TEST(MetricColumnsTest, AppendRejectsOtherMetrics) {
+    MetricColumns<double> columns(prototype());
+
+    Metric metric = prototype();
+    metric.set_data(int64_t(1));
+    EXPECT_FALSE(columns.append(metric));
+
+    metric.set_data(1.0);
+    EXPECT_TRUE(columns.append(metric));
+
+    metric.add_tag({"host", "node2"});
+    EXPECT_FALSE(columns.append(metric));
+
+    Metric other(Namespace({"intel", "net"})
+                    .add_dynamic_element("interface")
+                    .add_static_element("packets"),
+                 "B", "received bytes");
+    other.set_data(1.0);
+    EXPECT_FALSE(columns.append(other));
+    EXPECT_EQ(1, columns.size());
+
+    EXPECT_THROW(MetricColumns<double>::from_metrics({metric, other}), PluginException);
+}
@@ -18,8 +18,11 @@ limitations under the License.
 #include <chrono>
 #include <cstdint>
 #include <ctime>
+#include <map>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 
@@ -72,6 +75,39 @@ TEST(MetricTest, IsDynamicWorks){
     EXPECT_EQ(false, fake_static_namespace.is_dynamic());
 }
 
+TEST(MetricTest, NamespaceElementsAreInterned) {
+    Namespace first({"intel","procfs","cpu"});
+    Namespace second({"intel","procfs","disk"});
+    first.add_dynamic_element("cpu_id", "id of the cpu");
+    second.add_dynamic_element("cpu_id", "id of the cpu");
+
+    EXPECT_EQ(&first[2].get_value(), Plugin::StringPool::global().intern("cpu"));
+    EXPECT_EQ(&first[0].get_value(), &second[0].get_value());
+    EXPECT_EQ(&first[1].get_value(), &second[1].get_value());
+    EXPECT_NE(&first[3].get_value(), &second[3].get_value());
+    EXPECT_EQ(&first[3].get_name(), &second[3].get_name());
+    EXPECT_EQ(&first[3].get_description(), &second[3].get_description());
+    EXPECT_EQ("cpu_id", first[3].get_name());
+
+    size_t pooled = Plugin::StringPool::global().size();
+    for (int i = 0; i < 100; i++) {
+        first[3].set_value(std::to_string(i));
+    }
+    EXPECT_EQ("99", first[3].get_value());
+    EXPECT_EQ("*", second[3].get_value());
+    EXPECT_EQ(pooled, Plugin::StringPool::global().size());
+}
+
+TEST(MetricTest, StringPoolWorks) {
+    Plugin::StringPool pool;
+    const std::string* foo = pool.intern("foo");
+    EXPECT_EQ(foo, pool.intern(std::string("foo")));
+    EXPECT_NE(foo, pool.intern("bar"));
+    EXPECT_EQ(Plugin::StringPool::empty(), pool.intern(""));
+    EXPECT_EQ(2, pool.size());
+    EXPECT_EQ("foo", *foo);
+}
+
 TEST(MetricTest, SetNsUnitDescriptionWorks) {
     Metric fake_metric(Namespace({"foo","bar"}),"atoms","critical metric");
 
@@ -108,6 +144,61 @@ TEST(MetricTest, SetFromRpcMetricWorks) {
     EXPECT_EQ("bonk", fake_metric.get_rpc_metric_ptr()->tags().at("node"));
 }
 
+TEST(MetricTest, ArenaMetricWorks) {
+    google::protobuf::Arena arena;
+    Metric fake_metric(Namespace({"foo","bar"}),"atoms","critical metric", &arena);
+    fake_metric.add_tag(make_pair("host", "baz"));
+    fake_metric.set_data(int64_t(42));
+
+    EXPECT_EQ(&arena, fake_metric.get_arena());
+    EXPECT_EQ(&arena, fake_metric.get_rpc_metric_ptr()->mutable_timestamp()->GetArena());
+    EXPECT_FALSE(fake_metric.owns_rpc_metric_ptr());
+    EXPECT_EQ("/foo/bar", extract_ns(fake_metric));
+    EXPECT_EQ("baz", fake_metric.tags().at("host"));
+    EXPECT_EQ(42, fake_metric.get_int64_data());
+
+    Metric heap_metric;
+    EXPECT_EQ(nullptr, heap_metric.get_arena());
+    EXPECT_TRUE(heap_metric.owns_rpc_metric_ptr());
+}
+
+TEST(MetricTest, MoveWorks) {
+    static_assert(std::is_nothrow_move_constructible<Metric>::value, "Metric move may throw");
+    static_assert(std::is_nothrow_move_constructible<Namespace>::value, "Namespace move may throw");
+
+    Metric source(Namespace({"foo","bar"}),"atoms","critical metric");
+    source.add_tag(make_pair("host", "baz"));
+    rpc::Metric* rpc_metric = source.get_rpc_metric_ptr();
+
+    Metric moved(std::move(source));
+    EXPECT_EQ(rpc_metric, moved.get_rpc_metric_ptr());
+    EXPECT_TRUE(moved.owns_rpc_metric_ptr());
+    EXPECT_EQ("/foo/bar", extract_ns(moved));
+    EXPECT_EQ("baz", moved.tags().at("host"));
+
+    Metric assigned;
+    assigned = std::move(moved);
+    EXPECT_EQ(rpc_metric, assigned.get_rpc_metric_ptr());
+    EXPECT_EQ("atoms", assigned.get_rpc_metric_ptr()->unit());
+
+    Metric copied;
+    copied = assigned;
+    EXPECT_NE(rpc_metric, copied.get_rpc_metric_ptr());
+    EXPECT_EQ("/foo/bar", extract_ns(copied));
+}
+
+TEST(MetricTest, VectorGrowthDoesNotCopyMetrics) {
+    std::vector<Metric> metrics;
+    std::vector<rpc::Metric*> rpc_metrics;
+    for (int i = 0; i < 100; i++) {
+        metrics.emplace_back(Namespace({"foo", std::to_string(i)}), "", "");
+        rpc_metrics.push_back(metrics.back().get_rpc_metric_ptr());
+    }
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(rpc_metrics[i], metrics[i].get_rpc_metric_ptr());
+    }
+}
+
 TEST(MetricTest, SetTagsWorks) {
     Metric fake_metric;
     fake_metric.add_tag(make_pair("host", "zero"));
@@ -116,6 +207,21 @@ TEST(MetricTest, SetTagsWorks) {
     EXPECT_EQ("1hr", fake_metric.tags().at("period"));
 }
 
+TEST(MetricTest, TagsFollowUpdates) {
+    Metric fake_metric;
+    fake_metric.add_tag(make_pair("host", "zero"));
+    EXPECT_EQ(1, fake_metric.tags().size());
+    EXPECT_EQ(&fake_metric.get_rpc_metric_ptr()->tags(), &fake_metric.tags());
+
+    fake_metric.add_tag(make_pair("host", "one"));
+    fake_metric.add_tags(std::vector<pair<string, string>>{{"period", "1hr"}, {"zone", "eu"}});
+    fake_metric.add_tags(std::map<string, string>{{"zone", "us"}});
+    EXPECT_EQ(3, fake_metric.tags().size());
+    EXPECT_EQ("one", fake_metric.tags().at("host"));
+    EXPECT_EQ("1hr", fake_metric.tags().at("period"));
+    EXPECT_EQ("us", fake_metric.tags().at("zone"));
+}
+
 TEST(MetricTest, SetTimestampWorks) {
     Metric fake_metric;
     std::tm source_time{56,10,8,2,5,92,6,122,1}; // 02 May 1992, 08:10:56
@@ -130,6 +236,35 @@ TEST(MetricTest, SetTimestampWorks) {
     EXPECT_EQ(56, metric_time.tm_sec);
 }
 
+TEST(MetricTest, SetTimestampsWorks) {
+    std::vector<Metric> metrics(3);
+    system_clock::time_point tp = system_clock::from_time_t(704794256) +
+                                    std::chrono::nanoseconds(123456789);
+
+    Metric::set_timestamps(metrics, tp);
+    Metric::set_last_advertised_times(metrics, tp);
+    for (const Metric& metric : metrics) {
+        EXPECT_EQ(tp, metric.timestamp());
+        EXPECT_EQ(704794256, metric.get_rpc_metric_ptr()->lastadvertisedtime().sec());
+        EXPECT_EQ(123456789, metric.get_rpc_metric_ptr()->lastadvertisedtime().nsec());
+    }
+
+    Metric::set_timestamps(metrics);
+    EXPECT_LT(tp, metrics[0].timestamp());
+    EXPECT_EQ(metrics[0].timestamp(), metrics[2].timestamp());
+}
+
+TEST(MetricTest, CoarseClockWorks) {
+    Plugin::Clock::set_source(Plugin::ClockSource::Coarse);
+    system_clock::time_point coarse = Plugin::Clock::now();
+    Plugin::Clock::set_source(Plugin::ClockSource::Precise);
+    system_clock::time_point precise = Plugin::Clock::now();
+
+    EXPECT_EQ(Plugin::ClockSource::Precise, Plugin::Clock::get_source());
+    EXPECT_LE(coarse, precise);
+    EXPECT_LT(precise - coarse, std::chrono::seconds(1));
+}
+
 TEST(MetricTest, SetLastAdvertisedTimeWorks) {
     Metric fake_metric;
     std::tm source_time{13,55,15,29,9,8,1,272,1}; // Mon, 29 Sep 2008 15:55:13 -0400
@@ -181,12 +316,118 @@ TEST(MetricTest, SetDataWorks) {
     EXPECT_EQ(uint64_var, fake_metric.get_uint64_data());
 }
 
+TEST(MetricTest, SetBytesDataWorks) {
+    Metric fake_metric;
+
+    const char raw[] = {'a', '\0', 'b'};
+    fake_metric.set_bytes_data(raw, sizeof(raw));
+    EXPECT_EQ(Metric::DataType::Bytes, fake_metric.data_type());
+    EXPECT_EQ(string(raw, sizeof(raw)), fake_metric.get_bytes_data());
+
+    fake_metric.set_data(string("hop"));
+    EXPECT_EQ(Metric::DataType::String, fake_metric.data_type());
+}
+
+namespace {
+    struct TypeNamer {
+        string operator()(int32_t) const { return "int32"; }
+        string operator()(int64_t) const { return "int64"; }
+        string operator()(uint32_t) const { return "uint32"; }
+        string operator()(uint64_t) const { return "uint64"; }
+        string operator()(float) const { return "float32"; }
+        string operator()(double) const { return "float64"; }
+        string operator()(bool) const { return "bool"; }
+        string operator()(const string&) const { return "string"; }
+        string operator()(const Metric::BytesData&) const { return "bytes"; }
+        string operator()(const Metric::NoData&) const { return "not set"; }
+    };
+}
+
+TEST(MetricTest, VisitWorks) {
+    Metric fake_metric;
+    EXPECT_EQ("not set", fake_metric.visit(TypeNamer()));
+
+    fake_metric.set_data(int32_t(1));
+    EXPECT_EQ("int32", fake_metric.visit(TypeNamer()));
+    fake_metric.set_data(int64_t(1));
+    EXPECT_EQ("int64", fake_metric.visit(TypeNamer()));
+    fake_metric.set_data(uint32_t(1));
+    EXPECT_EQ("uint32", fake_metric.visit(TypeNamer()));
+    fake_metric.set_data(uint64_t(1));
+    EXPECT_EQ("uint64", fake_metric.visit(TypeNamer()));
+    fake_metric.set_data(1.5f);
+    EXPECT_EQ("float32", fake_metric.visit(TypeNamer()));
+    fake_metric.set_data(1.5);
+    EXPECT_EQ("float64", fake_metric.visit(TypeNamer()));
+    fake_metric.set_data(true);
+    EXPECT_EQ("bool", fake_metric.visit(TypeNamer()));
+    fake_metric.set_data(string("hop"));
+    EXPECT_EQ("string", fake_metric.visit(TypeNamer()));
+    fake_metric.set_bytes_data(string("hop"));
+    EXPECT_EQ("bytes", fake_metric.visit(TypeNamer()));
+
+    fake_metric.set_data(int64_t(42));
+    std::ostringstream os;
+    fake_metric.visit([&](const auto& value) { os << value; });
+    EXPECT_EQ("42", os.str());
+}
+
+TEST(MetricTest, NamespaceViewReadsMetric) {
+    Namespace ns({"intel", "cpp", "mock"});
+    ns.add_dynamic_element("host", "host name").add_static_element("load");
+    Metric metric(ns, "", "");
+    rpc::Metric* rpc_metric = metric.get_rpc_metric_ptr();
+
+    Plugin::NamespaceView view = metric.ns();
+    ASSERT_EQ(5, view.size());
+    EXPECT_EQ(&rpc_metric->namespace_(4).value(), &view[4].get_value());
+    EXPECT_EQ("host", view[3].get_name());
+    EXPECT_TRUE(view.is_dynamic());
+    EXPECT_EQ(std::vector<int>{3}, view.get_dynamic_indexes());
+    EXPECT_EQ(ns.get_string(), view.get_string());
+    EXPECT_EQ(ns.get_hash(), view.get_hash());
+    EXPECT_EQ(ns.get_hash({3}), view.get_hash({3}));
+    EXPECT_TRUE(view == ns);
+
+    rpc_metric->mutable_namespace_(3)->set_value("node1");
+    EXPECT_EQ("node1", metric.ns()[3].get_value());
+    EXPECT_TRUE(view != ns);
+
+    Namespace copy = metric.ns();
+    EXPECT_EQ("intel/cpp/mock/node1/load", copy.get_string());
+    EXPECT_EQ("host name", copy[3].get_description());
+}
+
 TEST(MetricTest, GetStringWorks) {
     Plugin::Namespace mynamespace({"intel","sdi","check","it"});
 
     EXPECT_EQ(mynamespace.get_string(), "intel/sdi/check/it");
 }
 
+TEST(MetricTest, ConstNamespaceKeyIsSharedAcrossThreads) {
+    const Plugin::Namespace shared({"intel","sdi","check","it"});
+    std::vector<uint64_t> hashes(4);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < hashes.size(); i++) {
+        readers.emplace_back([&shared, &hashes, i]() {
+            hashes[i] = shared.get_hash();
+        });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    for (auto hash : hashes) {
+        EXPECT_EQ(shared.get_hash(), hash);
+    }
+    EXPECT_EQ("intel/sdi/check/it", shared.get_string());
+
+    Plugin::Namespace copy(shared);
+    EXPECT_EQ(shared.get_hash(), copy.get_hash());
+    copy[3].set_value("that");
+    EXPECT_EQ("intel/sdi/check/that", copy.get_string());
+    EXPECT_NE(shared.get_hash(), copy.get_hash());
+}
+
 TEST(MetricTest, SetDiagnosticConfigWorks) {
     rpc::ConfigMap cfgmap;
     Plugin::Config config(cfgmap);
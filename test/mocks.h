@@ -16,6 +16,7 @@ limitations under the License.
 #include "snap/plugin.h"
 #include "snap/config.h"
 #include "snap/metric.h"
+#include "snap/reactor.h"
 #include "gmock/gmock.h"
 
 #include <string>
@@ -93,6 +94,9 @@ class MockStreamCollector : public Plugin::StreamCollectorInterface
     MOCK_METHOD1(get_metric_types, std::vector<Metric>(Config cfg));
 
     MOCK_METHOD0(stream_metrics, void());
+    MOCK_METHOD1(start_stream_events, bool(Plugin::Reactor& reactor));
+    MOCK_METHOD1(stop_stream_events, void(Plugin::Reactor& reactor));
+    MOCK_METHOD0(on_writable, void());
 
     MOCK_METHOD0(put_metrics_out, std::vector<Plugin::Metric>());
     MOCK_METHOD0(put_err_msg, std::string());
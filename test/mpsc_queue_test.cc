@@ -0,0 +1,73 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/mpsc_queue.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+using Plugin::MpscQueue;
+
+
+TEST(MpscQueueTest, PopsInPushOrder) {
+    MpscQueue<std::unique_ptr<int>> queue;
+    EXPECT_TRUE(queue.empty());
+    for (int i = 0; i < 10; i++) {
+        queue.push(std::unique_ptr<int>(new int(i)));
+    }
+    EXPECT_FALSE(queue.empty());
+
+    std::unique_ptr<int> value;
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(queue.pop(value));
+        EXPECT_EQ(i, *value);
+    }
+    EXPECT_FALSE(queue.pop(value));
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(MpscQueueTest, ConcurrentPushWorks) {
+    const int producers = 4;
+    const int count = 10000;
+    MpscQueue<int> queue;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p, count]() {
+            for (int i = 0; i < count; i++) {
+                queue.push(p * count + i);
+            }
+        });
+    }
+
+    // Values of a producer come out in the order it pushed them
+    std::vector<int> last(producers, -1);
+    int popped = 0;
+    int value;
+    while (popped < producers * count) {
+        if (!queue.pop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        int p = value / count;
+        EXPECT_LT(last[p], value % count);
+        last[p] = value % count;
+        popped++;
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    EXPECT_TRUE(queue.empty());
+}
@@ -0,0 +1,112 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/metric.h"
+#include "snap/namespace_index.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+
+using std::string;
+using Plugin::Metric;
+using Plugin::Namespace;
+using Plugin::NamespaceIndex;
+
+
+TEST(NamespaceTest, KeyAndHashWork) {
+    Namespace first({"intel","procfs","cpu"});
+    Namespace second({"intel","procfs"});
+
+    EXPECT_NE(first.get_hash(), second.get_hash());
+    EXPECT_NE(first, second);
+
+    second.add_static_element("cpu");
+    EXPECT_EQ("intel/procfs/cpu", second.get_string());
+    EXPECT_EQ(first.get_hash(), second.get_hash());
+    EXPECT_EQ(first, second);
+
+    second[2].set_value("disk");
+    EXPECT_EQ("intel/procfs/disk", second.get_string());
+    EXPECT_NE(first.get_hash(), second.get_hash());
+    EXPECT_NE(first, second);
+}
+
+TEST(NamespaceTest, WildcardHashWorks) {
+    Namespace concrete({"intel","procfs","cpu","3","user"});
+    Namespace dynamic({"intel","procfs","cpu"});
+    dynamic.add_dynamic_element("cpu_id").add_static_element("user");
+
+    EXPECT_NE(dynamic.get_hash(), concrete.get_hash());
+    EXPECT_EQ(dynamic.get_hash(), concrete.get_hash({3}));
+    EXPECT_EQ(concrete.get_hash(), concrete.get_hash({}));
+}
+
+TEST(NamespaceTest, StdHashWorks) {
+    std::unordered_set<Namespace> namespaces;
+    namespaces.insert(Namespace({"intel","procfs","cpu"}));
+    namespaces.insert(Namespace({"intel","procfs","cpu"}));
+    namespaces.insert(Namespace({"intel","procfs","disk"}));
+
+    EXPECT_EQ(2, namespaces.size());
+    EXPECT_EQ(1, namespaces.count(Namespace({"intel","procfs","disk"})));
+}
+
+TEST(NamespaceIndexTest, FindWorks) {
+    NamespaceIndex<string> index;
+    Namespace user_ns({"intel","procfs","cpu"});
+    user_ns.add_dynamic_element("cpu_id").add_static_element("user");
+    Namespace system_ns({"intel","procfs","cpu"});
+    system_ns.add_dynamic_element("cpu_id").add_static_element("system");
+
+    index.add(user_ns, "user_reader");
+    index.add(system_ns, "system_reader");
+    index.add(Namespace({"intel","procfs","uptime"}), "uptime_reader");
+    EXPECT_EQ(3, index.size());
+
+    ASSERT_NE(nullptr, index.find(user_ns));
+    EXPECT_EQ("user_reader", *index.find(user_ns));
+    ASSERT_NE(nullptr, index.find(Namespace({"intel","procfs","cpu","3","user"})));
+    EXPECT_EQ("user_reader", *index.find(Namespace({"intel","procfs","cpu","3","user"})));
+    ASSERT_NE(nullptr, index.find(Namespace({"intel","procfs","cpu","0","system"})));
+    EXPECT_EQ("system_reader", *index.find(Namespace({"intel","procfs","cpu","0","system"})));
+    ASSERT_NE(nullptr, index.find(Namespace({"intel","procfs","uptime"})));
+    EXPECT_EQ("uptime_reader", *index.find(Namespace({"intel","procfs","uptime"})));
+
+    EXPECT_EQ(nullptr, index.find(Namespace({"intel","procfs","cpu","3","idle"})));
+    EXPECT_EQ(nullptr, index.find(Namespace({"intel","procfs","cpu","3"})));
+
+    index.add(user_ns, "other_reader");
+    EXPECT_EQ(3, index.size());
+    EXPECT_EQ("other_reader", *index.find(Namespace({"intel","procfs","cpu","1","user"})));
+}
+
+TEST(NamespaceIndexTest, FindMetricNamespaceWorks) {
+    NamespaceIndex<string> index;
+    Namespace user_ns({"intel","procfs","cpu"});
+    user_ns.add_dynamic_element("cpu_id").add_static_element("user");
+    index.add(user_ns, "user_reader");
+    index.add(Namespace({"intel","procfs","uptime"}), "uptime_reader");
+
+    Metric user(Namespace({"intel","procfs","cpu","3","user"}), "", "");
+    Metric uptime(Namespace({"intel","procfs","uptime"}), "", "");
+    Metric idle(Namespace({"intel","procfs","cpu","3","idle"}), "", "");
+
+    ASSERT_NE(nullptr, index.find(user.ns()));
+    EXPECT_EQ("user_reader", *index.find(user.ns()));
+    ASSERT_NE(nullptr, index.find(uptime.ns()));
+    EXPECT_EQ("uptime_reader", *index.find(uptime.ns()));
+    EXPECT_EQ(nullptr, index.find(idle.ns()));
+}
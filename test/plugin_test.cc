@@ -65,6 +65,69 @@ TEST_F(PluginTest, MetaCtorWorks)
   EXPECT_EQ(Plugin::Processor, meta.type);
 }
 
+TEST_F(PluginTest, MetaUsesServerFlags)
+{
+  Plugin::Meta meta(Plugin::Collector, "rando", 1);
+  meta.max_send_message_size = 1024;
+
+  int argc = 10;
+  char* argv[]{(char*)"server-flags-plugin",
+               (char*)"--async-server",
+               (char*)"--max-recv-msg-size", (char*)"67108864",
+               (char*)"--keepalive-time", (char*)"30000",
+               (char*)"--compression", (char*)"gzip",
+               (char*)"--compression-threshold=4096",
+               (char*)"--resource-quota=1073741824"};
+  Plugin::Flags flags(argc, argv);
+  meta.use_cli_args(&flags);
+
+  EXPECT_TRUE(meta.async_server_enabled);
+  EXPECT_EQ(67108864, meta.max_receive_message_size);
+  EXPECT_EQ(1024, meta.max_send_message_size);
+  EXPECT_EQ(1073741824, meta.resource_quota_bytes);
+  EXPECT_EQ(std::chrono::milliseconds(30000), meta.keepalive_time);
+  EXPECT_EQ(std::chrono::milliseconds(0), meta.keepalive_timeout);
+  EXPECT_EQ(GRPC_COMPRESS_GZIP, meta.compression_algorithm);
+  EXPECT_EQ(4096, meta.compression_threshold);
+  EXPECT_EQ(0, meta.completion_queue_count);
+}
+
+TEST_F(PluginTest, FlagsReadDurations)
+{
+  int argc = 2;
+  char* argv[]{(char*)"duration-flags-plugin", (char*)"--max-collect-duration=10ms"};
+  Plugin::Flags flags(argc, argv);
+  EXPECT_EQ(std::chrono::milliseconds(10), flags.GetFlagDurationValue("max-collect-duration"));
+
+  char* seconds_argv[]{(char*)"duration-seconds-flags-plugin", (char*)"--max-collect-duration=5"};
+  Plugin::Flags seconds_flags(argc, seconds_argv);
+  EXPECT_EQ(std::chrono::seconds(5), seconds_flags.GetFlagDurationValue("max-collect-duration"));
+
+  char* default_argv[]{(char*)"duration-default-flags-plugin"};
+  Plugin::Flags default_flags(1, default_argv);
+  EXPECT_EQ(std::chrono::seconds(10), default_flags.GetFlagDurationValue("max-collect-duration"));
+
+  char* zero_argv[]{(char*)"duration-zero-flags-plugin", (char*)"--max-collect-duration=0ms"};
+  Plugin::Flags zero_flags(argc, zero_argv);
+  EXPECT_EQ(std::chrono::nanoseconds(0), zero_flags.GetFlagDurationValue("max-collect-duration"));
+}
+
+TEST_F(PluginTest, FlagsRejectInvalidDurations)
+{
+  int argc = 2;
+  std::vector<string> invalids{"--max-collect-duration=10 ms", "--max-collect-duration=1.5s",
+                               "--max-collect-duration=10sec", "--max-collect-duration=ms"};
+  for (int i = 0; i < invalids.size(); i++) {
+    // Flags loggers are named after the plugin, which must be unique
+    string name = "duration-invalid-flags-plugin-" + std::to_string(i);
+    const string& invalid = invalids[i];
+    char* argv[]{(char*)name.c_str(), (char*)invalid.c_str()};
+    Plugin::Flags flags(argc, argv);
+    EXPECT_THROW(flags.GetFlagDurationValue("max-collect-duration"), Plugin::PluginException)
+        << invalid;
+  }
+}
+
 TEST_F(PluginTest, CollectorInterfaceWorks)
 {
   MockCollector mock;
@@ -0,0 +1,141 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/plugin.h"
+#include "snap/reactor.h"
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using Plugin::Reactor;
+
+namespace {
+    /**
+    * Latch lets the test wait for callbacks run on the reactor thread.
+    */
+    class Latch {
+    public:
+        explicit Latch(int count) : _count(count) {}
+
+        void count_down() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_count > 0 && --_count == 0) {
+                _cond.notify_all();
+            }
+        }
+
+        bool wait() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _cond.wait_for(lock, std::chrono::seconds(5),
+                                  [this]() { return _count == 0; });
+        }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        int _count;
+    };
+}
+
+TEST(ReactorTest, TimerWorks) {
+    Reactor reactor;
+    Latch repeated(3), once(1);
+    std::atomic<int> once_calls(0);
+    reactor.add_timer(std::chrono::milliseconds(1), [&]() { repeated.count_down(); });
+    reactor.add_timer(std::chrono::milliseconds(1), [&]() {
+        once_calls++;
+        once.count_down();
+    }, false);
+    reactor.start();
+
+    EXPECT_TRUE(repeated.wait());
+    EXPECT_TRUE(once.wait());
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(1, once_calls.load());
+}
+
+TEST(ReactorTest, FdWorks) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    Reactor reactor;
+    Latch read_ready(1);
+    char received = 0;
+    Reactor::Handle handle = reactor.add_fd(fds[0], EPOLLIN, [&](uint32_t events) {
+        EXPECT_TRUE(events & EPOLLIN);
+        ASSERT_EQ(1, read(fds[0], &received, 1));
+        read_ready.count_down();
+    });
+    reactor.start();
+
+    ASSERT_EQ(1, write(fds[1], "x", 1));
+    EXPECT_TRUE(read_ready.wait());
+    EXPECT_EQ('x', received);
+
+    // Once removed, the pipe is left alone
+    reactor.call([&]() { reactor.remove(handle); });
+    ASSERT_EQ(1, write(fds[1], "y", 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ('x', received);
+
+    reactor.stop();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(ReactorTest, PostAndCallWork) {
+    Reactor reactor;
+    std::thread::id caller = std::this_thread::get_id();
+    std::thread::id ran_on;
+
+    // Not running: call runs on the calling thread
+    reactor.call([&]() { ran_on = std::this_thread::get_id(); });
+    EXPECT_EQ(caller, ran_on);
+
+    reactor.start();
+    reactor.call([&]() {
+        ran_on = std::this_thread::get_id();
+        EXPECT_TRUE(reactor.in_reactor_thread());
+    });
+    EXPECT_NE(caller, ran_on);
+    EXPECT_FALSE(reactor.in_reactor_thread());
+
+    Latch posted(2);
+    int order = 0, first = 0, second = 0;
+    reactor.post([&]() { first = ++order; posted.count_down(); });
+    reactor.post([&]() { second = ++order; posted.count_down(); });
+    EXPECT_TRUE(posted.wait());
+    EXPECT_EQ(1, first);
+    EXPECT_EQ(2, second);
+
+    EXPECT_THROW(reactor.call([]() { throw Plugin::PluginException("failed"); }),
+                 Plugin::PluginException);
+}
+
+TEST(ReactorTest, StopWorks) {
+    Reactor reactor;
+    reactor.start();
+    EXPECT_TRUE(reactor.running());
+    reactor.stop();
+    EXPECT_FALSE(reactor.running());
+
+    // Sources outlive a stop, and the reactor can run on the caller thread
+    reactor.add_timer(std::chrono::milliseconds(1), [&]() { reactor.stop(); }, false);
+    reactor.run();
+    EXPECT_FALSE(reactor.running());
+}
@@ -16,8 +16,14 @@ limitations under the License.
 #include <snap/proxy/stream_collector_proxy.h>
 #include "gmock/gmock.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "mocks.h"
@@ -25,6 +31,7 @@ limitations under the License.
 using Plugin::Config;
 using Plugin::ConfigPolicy;
 using Plugin::Metric;
+using Plugin::Namespace;
 using Plugin::StringRule;
 using Plugin::Proxy::StreamCollectorImpl;
 using Plugin::StreamCollectorInterface;
@@ -111,3 +118,600 @@ TEST(StreamCollectorProxyFailureTest, GetConfigPolicyReportsError)
     EXPECT_EQ(grpc::StatusCode::UNKNOWN, status.error_code());
     EXPECT_EQ("nothing to look at", status.error_message());
 }
+
+namespace {
+    /**
+    * FakeStream plays snapteld: Read hands out the queued requests, then
+    * blocks until the stream is closed. While held, Write blocks until the
+    * test lets it return, like a slow consumer.
+    */
+    class FakeStream : public Plugin::Proxy::StreamSession::Stream {
+    public:
+        void SendInitialMetadata() override {}
+
+        bool NextMessageSize(uint32_t* sz) override {
+            *sz = 0;
+            return false;
+        }
+
+        bool Read(rpc::CollectArg* msg) override {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, [this]() { return _closed || !_requests.empty(); });
+            if (_requests.empty())
+                return false;
+            *msg = _requests.front();
+            _requests.pop_front();
+            return true;
+        }
+
+        bool Write(const rpc::CollectReply& msg, grpc::WriteOptions options) override {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _writes++;
+            _cond.notify_all();
+            _cond.wait(lock, [this]() { return !_held || _allowed > 0 || _closed; });
+            if (_held && _allowed > 0)
+                _allowed--;
+            _replies.push_back(msg);
+            _cond.notify_all();
+            return true;
+        }
+
+        void hold() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _held = true;
+        }
+
+        /**
+        * release lets writes return: all of them, or only the next count.
+        */
+        void release(size_t count = 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (count == 0) {
+                _held = false;
+            } else {
+                _allowed += count;
+            }
+            _cond.notify_all();
+        }
+
+        bool wait_writes(size_t count) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _cond.wait_for(lock, std::chrono::seconds(5),
+                                  [&]() { return _writes >= count; });
+        }
+
+        void request(const rpc::CollectArg& arg) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _requests.push_back(arg);
+            _cond.notify_all();
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _cond.notify_all();
+        }
+
+        bool wait_replies(size_t count) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _cond.wait_for(lock, std::chrono::seconds(5),
+                                  [&]() { return _replies.size() >= count; });
+        }
+
+        size_t replies() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _replies.size();
+        }
+
+        rpc::CollectReply reply(size_t index) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _replies.at(index);
+        }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        std::deque<rpc::CollectArg> _requests;
+        std::vector<rpc::CollectReply> _replies;
+        bool _closed = false;
+        bool _held = false;
+        size_t _allowed = 0;
+        size_t _writes = 0;
+    };
+
+    rpc::CollectArg metrics_request(const Metric& metric) {
+        rpc::CollectArg arg;
+        *arg.mutable_metrics_arg()->add_metrics() = *metric.get_rpc_metric_ptr();
+        return arg;
+    }
+
+    Metric gauge(const string& name, int64_t value) {
+        Metric metric(Namespace({"foo", name}), "", "");
+        metric.set_data(value);
+        return metric;
+    }
+
+    /**
+    * StreamCall serves a StreamMetrics call requesting all the foo/[id]
+    * metrics of mockee on stream, until it goes out of scope. Once it is
+    * constructed, the plugin is in stream_metrics, ready to send. The
+    * request may set limits for the stream, as snapteld does.
+    */
+    class StreamCall {
+    public:
+        StreamCall(MockStreamCollector& mockee, FakeStream& stream,
+                   const rpc::CollectArg& limits = rpc::CollectArg()) :
+                _collector(&mockee), _stream(stream), _streaming(false), _ending(false) {
+            EXPECT_CALL(mockee, get_metrics_in(_)).Times(testing::AtLeast(1));
+            // The plugin streams until the call is over
+            EXPECT_CALL(mockee, stream_metrics())
+                .WillRepeatedly(Invoke([this]() {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _streaming = true;
+                    _cond.notify_all();
+                    _cond.wait(lock, [this]() { return _ending; });
+                }));
+            Namespace any_ns({"foo"});
+            any_ns.add_dynamic_element("id");
+            rpc::CollectArg request = metrics_request(Metric(any_ns, "", ""));
+            request.MergeFrom(limits);
+            _stream.request(request);
+            _call = std::thread([this]() { _collector.StreamMetrics(&_ctx, &_stream); });
+            std::unique_lock<std::mutex> lock(_mutex);
+            EXPECT_TRUE(_cond.wait_for(lock, std::chrono::seconds(5),
+                                       [this]() { return _streaming; }));
+        }
+
+        ~StreamCall() {
+            _stream.release();
+            _stream.close();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _ending = true;
+                _cond.notify_all();
+            }
+            _call.join();
+        }
+
+    private:
+        StreamCollectorImpl _collector;
+        FakeStream& _stream;
+        grpc::ServerContext _ctx;
+        std::thread _call;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        bool _streaming;
+        bool _ending;
+    };
+
+    bool wait_writable(MockStreamCollector& mockee) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (mockee.would_block()) {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    /**
+    * sent returns the values of the metrics written on stream, in order.
+    */
+    vector<int64_t> sent(FakeStream& stream) {
+        vector<int64_t> values;
+        for (size_t i = 0; i < stream.replies(); i++) {
+            rpc::CollectReply reply = stream.reply(i);
+            for (const rpc::Metric& met : reply.metrics_reply().metrics())
+                values.push_back(met.int64_data());
+        }
+        return values;
+    }
+}
+
+TEST(StreamCollectorProxySuccessTest, PartialBufferIsSentOnDeadline)
+{
+    MockStreamCollector mockee;
+    FakeStream stream;
+    rpc::CollectArg limits;
+    limits.set_maxmetricsbuffer(10);
+    limits.set_maxcollectduration(std::chrono::nanoseconds(std::chrono::milliseconds(100)).count());
+    StreamCall call(mockee, stream, limits);
+
+    // Fewer metrics than the buffer holds, and no send afterwards
+    auto start = std::chrono::steady_clock::now();
+    mockee.send_metrics(vector<Metric>{gauge("bar", 1), gauge("baz", 2)});
+    mockee.send_metrics(vector<Metric>{gauge("bar", 3)});
+    EXPECT_EQ(0, stream.replies());
+
+    ASSERT_TRUE(stream.wait_replies(1));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(300));
+    EXPECT_EQ(1, stream.replies());
+    EXPECT_EQ(vector<int64_t>({1, 2, 3}), sent(stream));
+}
+
+TEST(StreamCollectorProxySuccessTest, InFlightLimitBlocksProducers)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    mockee.SetMaxInFlight(2);
+    std::atomic<int> writable(0);
+    EXPECT_CALL(mockee, on_writable())
+        .WillRepeatedly(Invoke([&]() { writable++; }));
+    FakeStream stream;
+    stream.hold();
+    StreamCall call(mockee, stream);
+
+    // One send being written, one queued: the limit is reached
+    mockee.send_metrics(vector<Metric>{gauge("bar", 1)});
+    ASSERT_TRUE(stream.wait_writes(1));
+    EXPECT_FALSE(mockee.would_block());
+    mockee.send_metrics(vector<Metric>{gauge("bar", 2)});
+    EXPECT_TRUE(mockee.would_block());
+
+    std::atomic<bool> sent_third(false);
+    std::thread producer([&]() {
+        mockee.send_metrics(vector<Metric>{gauge("bar", 3)});
+        sent_third = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(sent_third);
+    EXPECT_EQ(0, writable);
+
+    // Writing the first send makes room: the producer is woken up, and fills
+    // it while the writer is stuck on the second send.
+    stream.release(1);
+    producer.join();
+    ASSERT_TRUE(stream.wait_writes(2));
+    EXPECT_EQ(1, writable);
+    EXPECT_TRUE(mockee.would_block());
+    EXPECT_EQ(1, stream.replies());
+
+    stream.release();
+    ASSERT_TRUE(stream.wait_replies(3));
+    ASSERT_TRUE(wait_writable(mockee));
+    EXPECT_EQ(vector<int64_t>({1, 2, 3}), sent(stream));
+    EXPECT_EQ(0, mockee.dropped_metrics());
+}
+
+TEST(StreamCollectorProxySuccessTest, DropNewestDropsBlockedSends)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    mockee.SetMaxInFlight(1);
+    mockee.SetOverflowPolicy(Plugin::OverflowPolicy::DropNewest);
+    FakeStream stream;
+    stream.hold();
+    StreamCall call(mockee, stream);
+
+    mockee.send_metrics(vector<Metric>{gauge("bar", 1)});
+    ASSERT_TRUE(stream.wait_writes(1));
+    mockee.send_metrics(vector<Metric>{gauge("bar", 2), gauge("baz", 3)});
+    EXPECT_EQ(2, mockee.dropped_metrics());
+
+    stream.release();
+    ASSERT_TRUE(wait_writable(mockee));
+    mockee.send_metrics(vector<Metric>{gauge("bar", 4)});
+    ASSERT_TRUE(stream.wait_replies(2));
+    EXPECT_EQ(vector<int64_t>({1, 4}), sent(stream));
+    EXPECT_EQ(2, mockee.dropped_metrics());
+}
+
+TEST(StreamCollectorProxySuccessTest, DropOldestDropsQueuedSends)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    mockee.SetMaxInFlight(1);
+    mockee.SetOverflowPolicy(Plugin::OverflowPolicy::DropOldest);
+    FakeStream stream;
+    stream.hold();
+    StreamCall call(mockee, stream);
+
+    // Sends are queued over the limit without blocking...
+    mockee.send_metrics(vector<Metric>{gauge("bar", 1)});
+    ASSERT_TRUE(stream.wait_writes(1));
+    mockee.send_metrics(vector<Metric>{gauge("bar", 2)});
+    mockee.send_metrics(vector<Metric>{gauge("bar", 3), gauge("baz", 4)});
+    EXPECT_EQ(0, mockee.dropped_metrics());
+
+    // ...and the oldest are dropped by the writer, down to the limit
+    stream.release();
+    ASSERT_TRUE(stream.wait_replies(2));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(vector<int64_t>({1, 3, 4}), sent(stream));
+    EXPECT_EQ(1, mockee.dropped_metrics());
+}
+
+TEST(StreamCollectorProxySuccessTest, SampleKeepsOneBlockedSendOutOfRate)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    mockee.SetMaxInFlight(1);
+    mockee.SetOverflowPolicy(Plugin::OverflowPolicy::Sample);
+    mockee.SetOverflowSampleRate(3);
+    FakeStream stream;
+    stream.hold();
+    StreamCall call(mockee, stream);
+
+    mockee.send_metrics(vector<Metric>{gauge("bar", 1)});
+    ASSERT_TRUE(stream.wait_writes(1));
+    mockee.send_metrics(vector<Metric>{gauge("bar", 2)});
+    mockee.send_metrics(vector<Metric>{gauge("bar", 3)});
+    EXPECT_EQ(2, mockee.dropped_metrics());
+
+    // The third send is kept, and waits for room
+    std::atomic<bool> sent_kept(false);
+    std::thread producer([&]() {
+        mockee.send_metrics(vector<Metric>{gauge("bar", 4)});
+        sent_kept = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(sent_kept);
+
+    stream.release();
+    producer.join();
+    ASSERT_TRUE(stream.wait_replies(2));
+    EXPECT_EQ(vector<int64_t>({1, 4}), sent(stream));
+    EXPECT_EQ(2, mockee.dropped_metrics());
+}
+
+TEST(StreamCollectorProxySuccessTest, CoalesceLatestSendsLatestOnceWritable)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    mockee.SetMaxInFlight(1);
+    mockee.SetOverflowPolicy(Plugin::OverflowPolicy::CoalesceLatest);
+    FakeStream stream;
+    stream.hold();
+    StreamCall call(mockee, stream);
+
+    mockee.send_metrics(vector<Metric>{gauge("bar", 1)});
+    ASSERT_TRUE(stream.wait_writes(1));
+    mockee.send_metrics(vector<Metric>{gauge("bar", 2), gauge("baz", 3)});
+    mockee.send_metrics(vector<Metric>{gauge("bar", 4)});
+    // The overwritten bar is counted as dropped
+    EXPECT_EQ(1, mockee.dropped_metrics());
+
+    stream.release();
+    ASSERT_TRUE(stream.wait_replies(2));
+    EXPECT_EQ(2, stream.replies());
+    EXPECT_EQ(vector<int64_t>({1, 4, 3}), sent(stream));
+    EXPECT_EQ(1, mockee.dropped_metrics());
+}
+
+TEST(StreamCollectorProxySuccessTest, CoalesceMetricsSendsLatestPerWindow)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    mockee.SetMaxCollectDuration(std::chrono::milliseconds(200));
+    mockee.SetCoalesceMetrics(true);
+    FakeStream stream;
+    StreamCall call(mockee, stream);
+
+    for (int64_t value = 1; value <= 5; value++)
+        mockee.send_metrics(vector<Metric>{gauge("bar", value)});
+    ASSERT_TRUE(stream.wait_replies(1));
+    EXPECT_EQ(vector<int64_t>({5}), sent(stream));
+    EXPECT_EQ(0, mockee.dropped_metrics());
+
+    // Empty windows roll over without sending anything...
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    EXPECT_EQ(1, stream.replies());
+
+    // ...so metrics sent afterwards are still coalesced over a whole window,
+    // rather than sent right away on an expired one.
+    auto start = std::chrono::steady_clock::now();
+    mockee.send_metrics(vector<Metric>{gauge("bar", 6)});
+    mockee.send_metrics(vector<Metric>{gauge("bar", 7)});
+    ASSERT_TRUE(stream.wait_replies(2));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(400));
+    EXPECT_EQ(vector<int64_t>({5, 7}), sent(stream));
+}
+
+TEST(StreamCollectorProxySuccessTest, StreamMetricsServesConcurrentSessions)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    // Each session requests metrics, then the first one ends
+    EXPECT_CALL(mockee, get_metrics_in(_)).Times(3);
+    ON_CALL(mockee, stream_metrics())
+        .WillByDefault(Invoke([&]() {
+            while (!mockee.StreamCollectorInterface::context_cancelled()) {
+                mockee.send_metrics(vector<Metric>{mockee.fake_metric});
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }));
+
+    StreamCollectorImpl streamCollector(&mockee);
+    FakeStream first, second;
+    first.request(metrics_request(mockee.fake_metric));
+    second.request(metrics_request(mockee.fake_metric));
+    grpc::ServerContext first_ctx, second_ctx;
+    grpc::Status first_status, second_status;
+    std::thread first_call([&]() {
+        first_status = streamCollector.StreamMetrics(&first_ctx, &first);
+    });
+    std::thread second_call([&]() {
+        second_status = streamCollector.StreamMetrics(&second_ctx, &second);
+    });
+
+    EXPECT_TRUE(first.wait_replies(3));
+    EXPECT_TRUE(second.wait_replies(3));
+    EXPECT_FALSE(mockee.StreamCollectorInterface::context_cancelled());
+
+    // EOF ends a session, the other one keeps streaming
+    first.close();
+    first_call.join();
+    size_t sent = second.replies();
+    EXPECT_TRUE(second.wait_replies(sent + 3));
+
+    second.close();
+    second_call.join();
+    EXPECT_TRUE(mockee.StreamCollectorInterface::context_cancelled());
+    EXPECT_EQ(grpc::StatusCode::OK, first_status.error_code());
+    EXPECT_EQ(grpc::StatusCode::OK, second_status.error_code());
+}
+
+TEST(StreamCollectorProxySuccessTest, StreamMetricsEndsOnEarlyEOF)
+{
+    MockStreamCollector mockee;
+    EXPECT_CALL(mockee, get_metrics_in(_)).Times(0);
+    EXPECT_CALL(mockee, stream_metrics()).Times(0);
+
+    StreamCollectorImpl streamCollector(&mockee);
+    FakeStream stream;
+    stream.close();
+    grpc::ServerContext ctx;
+    grpc::Status status = streamCollector.StreamMetrics(&ctx, &stream);
+    EXPECT_EQ(grpc::StatusCode::OK, status.error_code());
+    EXPECT_EQ(0, stream.replies());
+}
+
+TEST(StreamCollectorProxySuccessTest, StreamMetricsSendsSubscribedMetrics)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    Metric bar(Namespace({"foo", "bar"}), "", "");
+    Metric baz(Namespace({"foo", "baz"}), "", "");
+    Namespace any_ns({"foo"});
+    any_ns.add_dynamic_element("id");
+    Metric any(any_ns, "", "");
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t requested = 0;
+    EXPECT_CALL(mockee, get_metrics_in(_))
+        .Times(testing::AtLeast(2))
+        .WillRepeatedly(Invoke([&](vector<Metric>& metsIn) {
+            std::lock_guard<std::mutex> lock(mutex);
+            requested = metsIn.size();
+            cond.notify_all();
+        }));
+    EXPECT_CALL(mockee, stream_metrics()).Times(testing::AtLeast(1));
+
+    StreamCollectorImpl streamCollector(&mockee);
+    FakeStream first, second;
+    first.request(metrics_request(bar));
+    second.request(metrics_request(any));
+    grpc::ServerContext first_ctx, second_ctx;
+    std::thread first_call([&]() { streamCollector.StreamMetrics(&first_ctx, &first); });
+    std::thread second_call([&]() { streamCollector.StreamMetrics(&second_ctx, &second); });
+    {
+        // The plugin is asked for the metrics of both sessions
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(cond.wait_for(lock, std::chrono::seconds(5),
+                                  [&]() { return requested == 2; }));
+    }
+
+    mockee.send_metrics(vector<Metric>{bar, baz});
+    ASSERT_TRUE(first.wait_replies(1));
+    ASSERT_TRUE(second.wait_replies(1));
+    rpc::CollectReply first_reply = first.reply(0);
+    ASSERT_EQ(1, first_reply.metrics_reply().metrics_size());
+    EXPECT_EQ("/foo/bar", extract_ns(first_reply.metrics_reply().metrics(0)));
+    rpc::CollectReply second_reply = second.reply(0);
+    ASSERT_EQ(2, second_reply.metrics_reply().metrics_size());
+    EXPECT_EQ("/foo/bar", extract_ns(second_reply.metrics_reply().metrics(0)));
+    EXPECT_EQ("/foo/baz", extract_ns(second_reply.metrics_reply().metrics(1)));
+
+    first.close();
+    first_call.join();
+    {
+        // Then for the metrics of the session left
+        std::unique_lock<std::mutex> lock(mutex);
+        EXPECT_TRUE(cond.wait_for(lock, std::chrono::seconds(5),
+                                  [&]() { return requested == 1; }));
+    }
+    second.close();
+    second_call.join();
+}
+
+TEST(StreamCollectorProxySuccessTest, StreamMetricsStreamsFromEvents)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    Plugin::Reactor::Handle timer = 0;
+    EXPECT_CALL(mockee, get_metrics_in(_)).Times(1);
+    EXPECT_CALL(mockee, stream_metrics()).Times(0);
+    EXPECT_CALL(mockee, start_stream_events(_))
+        .WillOnce(Invoke([&](Plugin::Reactor& reactor) {
+            timer = reactor.add_timer(std::chrono::milliseconds(1), [&]() {
+                mockee.send_metrics(vector<Metric>{mockee.fake_metric});
+            });
+            return true;
+        }));
+    EXPECT_CALL(mockee, stop_stream_events(_))
+        .WillOnce(Invoke([&](Plugin::Reactor& reactor) {
+            reactor.remove(timer);
+        }));
+
+    StreamCollectorImpl streamCollector(&mockee);
+    FakeStream stream;
+    stream.request(metrics_request(mockee.fake_metric));
+    grpc::ServerContext ctx;
+    grpc::Status status;
+    std::thread call([&]() { status = streamCollector.StreamMetrics(&ctx, &stream); });
+
+    EXPECT_TRUE(stream.wait_replies(3));
+    stream.close();
+    call.join();
+    EXPECT_EQ(grpc::StatusCode::OK, status.error_code());
+}
+
+TEST(StreamCollectorProxySuccessTest, StreamMetricsUsesSharedReactor)
+{
+    MockStreamCollector mockee;
+    Plugin::Reactor shared;
+    shared.start();
+    EXPECT_CALL(mockee, get_metrics_in(_)).Times(1);
+    EXPECT_CALL(mockee, start_stream_events(_))
+        .WillOnce(Invoke([&](Plugin::Reactor& reactor) {
+            EXPECT_EQ(&shared, &reactor);
+            EXPECT_TRUE(reactor.in_reactor_thread());
+            return true;
+        }));
+    EXPECT_CALL(mockee, stop_stream_events(_))
+        .WillOnce(Invoke([&](Plugin::Reactor& reactor) {
+            EXPECT_TRUE(reactor.in_reactor_thread());
+        }));
+
+    StreamCollectorImpl streamCollector(&mockee);
+    streamCollector.SetReactor(&shared);
+    FakeStream stream;
+    stream.request(metrics_request(mockee.fake_metric));
+    stream.close();
+    grpc::ServerContext ctx;
+    grpc::Status status = streamCollector.StreamMetrics(&ctx, &stream);
+    EXPECT_EQ(grpc::StatusCode::OK, status.error_code());
+    EXPECT_TRUE(shared.running());
+}
+
+TEST(StreamCollectorProxySuccessTest, CoalesceLatestKeepsQueuedOrder)
+{
+    MockStreamCollector mockee;
+    mockee.SetMaxMetricsBuffer(0);
+    mockee.SetMaxInFlight(2);
+    mockee.SetOverflowPolicy(Plugin::OverflowPolicy::CoalesceLatest);
+    FakeStream stream;
+    stream.hold();
+    StreamCall call(mockee, stream);
+
+    // The writer is stuck on the first send, the second one fills the queue
+    mockee.send_metrics(vector<Metric>{gauge("bar", 1)});
+    ASSERT_TRUE(stream.wait_writes(1));
+    mockee.send_metrics(vector<Metric>{gauge("bar", 2)});
+    EXPECT_TRUE(mockee.would_block());
+    mockee.send_metrics(vector<Metric>{gauge("bar", 3)});
+
+    // Room comes back while the writer is busy with the second send: the
+    // next send supersedes the coalesced metric.
+    stream.release(1);
+    ASSERT_TRUE(stream.wait_writes(2));
+    EXPECT_FALSE(mockee.would_block());
+    mockee.send_metrics(vector<Metric>{gauge("bar", 4)});
+
+    stream.release();
+    ASSERT_TRUE(stream.wait_replies(3));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(vector<int64_t>({1, 2, 4}), sent(stream));
+    EXPECT_EQ(1, mockee.dropped_metrics());
+}
@@ -0,0 +1,54 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/thread_pool.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+
+using Plugin::ThreadPool;
+
+
+TEST(ThreadPoolTest, SubmitWorks) {
+    ThreadPool pool(4);
+    EXPECT_EQ(4, pool.size());
+
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 100; i++) {
+        results.push_back(pool.submit([i]() { return i * i; }));
+    }
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(i * i, results[i].get());
+    }
+}
+
+TEST(ThreadPoolTest, SubmitForwardsExceptions) {
+    ThreadPool pool(1);
+    std::future<void> result = pool.submit([]() { throw std::runtime_error("boom"); });
+    EXPECT_THROW(result.get(), std::runtime_error);
+}
+
+TEST(ThreadPoolTest, DestructorRunsQueuedTasks) {
+    std::atomic<int> count(0);
+    {
+        ThreadPool pool(2);
+        for (int i = 0; i < 50; i++) {
+            pool.submit([&count]() { count++; });
+        }
+    }
+    EXPECT_EQ(50, count.load());
+}